@@ -100,6 +100,16 @@ namespace ArenaAlloc
       m_impl->incrementRefCount();
     }
     
+    // containers assign allocators when they propagate on move
+    // assignment, the arena assigned over loses its reference.
+    Alloc& operator = ( const Alloc& src ) throw()
+    {
+      src.m_impl->incrementRefCount();
+      m_impl->decrementRefCount();
+      m_impl = src.m_impl;
+      return *this;
+    }
+    
     ~Alloc() throw() 
     {
       m_impl->decrementRefCount();
@@ -114,7 +124,12 @@ namespace ArenaAlloc
     // allocate but don't initialize num elements of type T
     pointer allocate (size_type num, const void* = 0) 
     {
+#if __cplusplus >= 201103L
+      // honour alignas() on T including extended alignment
+      return reinterpret_cast<pointer>( m_impl->allocate( num*sizeof(T), alignof(T) ) );
+#else
       return reinterpret_cast<pointer>( m_impl->allocate(num*sizeof(T)) );
+#endif
     }
 
     // initialize elements of allocated storage p with value value
@@ -141,7 +156,16 @@ namespace ArenaAlloc
     // deallocate storage p of deleted elements
     void deallocate (pointer p, size_type num) 
     {
-      m_impl->deallocate( p );
+      m_impl->deallocate( p, num*sizeof(T) );
+    }
+    
+    // Resizes the allocation of oldNum elements at p to newNum elements
+    // without moving it, possible when it is the last allocation made
+    // from the arena and the block has room.  Returns false otherwise.
+    // See ArenaVector in arenavector.h.
+    bool tryExpand( pointer p, size_type oldNum, size_type newNum )
+    {
+      return m_impl->tryExpand( p, oldNum*sizeof(T), newNum*sizeof(T) );
     }
     
     bool equals( const MemblockImpl * impl ) const
@@ -172,14 +196,108 @@ namespace ArenaAlloc
     size_t getNumAllocations() { return m_impl->getNumAllocations(); }
     size_t getNumDeallocations() { return m_impl->getNumDeallocations(); }
     size_t getNumBytesAllocated() { return m_impl->getNumBytesAllocated(); }    
+    
+#ifdef ARENA_ALLOC_STATS
+    // Detailed statistics, see ArenaStats.  Not available for arenas of
+    // the concurrent and shared memory implementations.
+    ArenaStats getStats() const { return m_impl->getStats(); }
+#endif
+    
+#ifdef ARENA_ALLOC_REGISTRY
+    // Names the arena in the registry, see arenaregistry.h.  The label
+    // must outlive the arena, i.e. a string literal.
+    void setLabel( const char * label ) { m_impl->setLabel( label ); }
+#endif
+    
+    // Allocations of more than numBytes get memory of their own from the
+    // allocator implementation, returned to it when they are deallocated,
+    // i.e. the buffers a growing vector leaves behind.  Set it before
+    // allocating.  Ignored by the recycle arena, which reuses memory
+    // itself.
+    void setLargeThreshold( std::size_t numBytes ) { m_impl->setLargeThreshold( numBytes ); }
+    
+    // Untyped allocation from the arena for adapters such as the
+    // memory_resource in memoryresource.h.
+    void * allocateBytes( std::size_t numBytes, std::size_t alignment ) 
+    { 
+      return m_impl->allocate( numBytes, alignment ); 
+    }
+    
+    // Deallocation with the size and alignment the memory was allocated
+    // with, for arenas which need them to find it again.  The slab arena
+    // serves over-aligned requests from its blocks rather than its slots.
+    void deallocateBytes( void * p, std::size_t numBytes, std::size_t alignment = sizeof( std::size_t ) )
+    {
+      m_impl->deallocate( p, numBytes, alignment );
+    }
+    
+    // Destroys the arena for reference count policies which leave its
+    // lifetime to the caller.  No allocator sharing the arena may be
+    // used afterwards.
+    void releaseArena() { MemblockImpl::destroy( m_impl ); }
+    
+    // Checkpoints.  rewind discards everything allocated from the arena, by
+    // this or any other allocator sharing it, since the mark was taken.
+    // Objects allocated after the mark must no longer be in use.  Nor may
+    // an object allocated before it be deallocated with its size while the
+    // mark is outstanding: if it was the basic arena's last allocation the
+    // cursor moves back below the mark and a rewind cuts through whatever
+    // was allocated there since.  Marks are rewound innermost first.  A
+    // mark past the arena's current position, i.e. discarded by rewinding
+    // to an earlier one, is ignored.
+    ArenaMark mark() { return m_impl->mark(); }
+    void rewind( const ArenaMark& m ) { m_impl->rewind( m ); }
+    
+    // Empties the arena but keeps up to maxRetainedBytes of its blocks
+    // warm for reuse.  Nothing allocated from the arena may still be in use.
+    void reset( std::size_t maxRetainedBytes = std::numeric_limits<std::size_t>::max() )
+    {
+      m_impl->reset( maxRetainedBytes );
+    }
   };
   
-  template<typename A>
-  template<typename T>
-  void _memblockimpl<A>::assign( const Alloc<T,A, _memblockimpl<A> >& src, _memblockimpl<A> *& dest )
+  // Marks the arena on construction and rewinds it on destruction so
+  // the scratch allocations of a scope are thrown away when it exits.
+  // i.e.
+  //   {
+  //     ArenaAlloc::RewindGuard< ArenaAlloc::Alloc<char> > scratch( alloc );
+  //     ... per request work allocating from alloc ...
+  //   }
+  template< typename AllocType >
+  class RewindGuard
   {
-    dest = const_cast<_memblockimpl<A>* >(src.m_impl);
-  }
+    AllocType m_alloc; // holds a reference to the arena while in scope
+    ArenaMark m_mark;
+    
+    RewindGuard( const RewindGuard& );
+    RewindGuard& operator = ( const RewindGuard& );
+    
+  public:
+    explicit RewindGuard( const AllocType& alloc ):
+      m_alloc( alloc ),
+      m_mark( m_alloc.mark() )
+    {
+    }
+    
+    ~RewindGuard()
+    {
+      m_alloc.rewind( m_mark );
+    }
+  };
+  
+#if __cplusplus >= 201103L
+  // Arena allocator whose allocations are all aligned to at least
+  // Alignment bytes, i.e. 64 to keep every allocation on its own
+  // cache line or 32 for AVX vectors.
+  template< typename T, std::size_t Alignment, typename Allocator = _newAllocatorImpl >
+  using AlignedAlloc = Alloc< T, Allocator, _memblockimpl<Allocator, Alignment> >;
+  
+  // Arena allocator whose blocks are sized by GrowthPolicy, i.e.
+  //   ArenaAlloc::GrowthAlloc< char, ArenaAlloc::_geometricGrowth<> > alloc( 4096 );
+  // starts with a 4KB block and doubles up to 64MB blocks.
+  template< typename T, typename GrowthPolicy, typename Allocator = _newAllocatorImpl >
+  using GrowthAlloc = Alloc< T, Allocator, _memblockimpl<Allocator, sizeof( _roundsize ), _plainRefCount, GrowthPolicy> >;
+#endif
   
 }
 
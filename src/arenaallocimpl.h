@@ -9,67 +9,111 @@
 #ifndef _ARENA_ALLOC_IMPL_H
 #define _ARENA_ALLOC_IMPL_H
 
+#include <stdint.h>
+#include <limits>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <chrono>
+#endif
+
 #ifdef ARENA_ALLOC_DEBUG
 #include <stdio.h>
 #endif
 
+// Define macro ARENA_ALLOC_REGISTRY to register every arena in a process
+// wide registry for telemetry
+#ifdef ARENA_ALLOC_REGISTRY
+#include "arenaregistry.h"
+#endif
+
+// Define macro ARENA_ALLOC_TRACE to record binary trace events of the
+// arenas into per thread ring buffers
+#ifdef ARENA_ALLOC_TRACE
+#include "arenatrace.h"
+#endif
+
 namespace ArenaAlloc
 {
 
   template< typename T, typename A, typename M >
   class Alloc;
   
+  // allocations are rounded up to a multiple of the size of this
+  // union by default to maintain proper alignment for any pointer and
+  // double values stored in the allocation.  Stricter alignment
+  // (cache lines, SIMD vectors, device dependent mappings) may be
+  // requested per arena or per allocation.
+  union _roundsize
+  {
+    double d;
+    void * p;
+  };
+  
   // internal structure for tracking memory blocks
   template < typename AllocImpl >
   struct _memblock
   {
-    // allocations are rounded up to a multiple of the size of this
-    // struct to maintain proper alignment for any pointer and double
-    // values stored in the allocation.
-    // A future goal is to support even stricter alignment for example
-    // to support cache alignment, special device  dependent mappings,
-    // or GPU ops.    
-    union _roundsize
-    {
-      double d;
-      void * p;
-    };
+    // the usable part of every block starts on a cache line boundary
+    // regardless of the alignment returned by the allocator implementation.
+    static const std::size_t BlockAlignment = 64;
     
     _memblock * m_next; // blocks kept link listed for cleanup at end
-    std::size_t m_bufferSize; // size of the buffer
+    std::size_t m_bufferSize; // usable size of the buffer
     std::size_t m_index; // index of next allocatable byte in the block
     char * m_buffer; // pointer to large block to allocate from
+    char * m_rawBuffer; // pointer obtained from the allocator implementation
+    std::size_t m_rawSize; // bytes obtained from the allocator implementation
     
-    _memblock( std::size_t bufferSize, AllocImpl& allocImpl ):
-      m_bufferSize( roundSize( bufferSize ) ),
+    _memblock( std::size_t bufferSize, AllocImpl& allocImpl, std::size_t alignment = BlockAlignment ):
+      m_next( 0 ),
+      m_bufferSize( bufferSize ),
       m_index( 0 ),
-      m_buffer( reinterpret_cast<char*>( allocImpl.allocate( bufferSize ) ) ) // this works b/c of order of decl
+      m_buffer( 0 ),
+      m_rawBuffer( 0 ),
+      m_rawSize( alignment > BlockAlignment ? bufferSize + alignment : bufferSize )
     {
+      // give up the few leading bytes needed to align the buffer rather
+      // than over-allocating, so power of 2 block sizes are preserved
+      // for allocator implementations working in pages.  A stricter
+      // alignment, i.e. a page, over-allocates instead so the buffer
+      // holds bufferSize bytes from an aligned start.
+      m_rawBuffer = reinterpret_cast<char*>( allocImpl.allocate( m_rawSize ) );
+      m_buffer = alignPtr( m_rawBuffer, alignment );
+      if( alignment <= BlockAlignment )
+	m_bufferSize -= m_buffer - m_rawBuffer;
     }
 
-    std::size_t roundSize( std::size_t numBytes )
+    // alignment must be a power of 2
+    static std::size_t roundSize( std::size_t numBytes, std::size_t alignment )
     {
       // this is subject to overflow.  calling logic should not permit
       // an attempt to allocate a really massive size.
       // i.e. an attempt to allocate 10s of terabytes should be an error      
-      return ( ( numBytes + sizeof( _roundsize ) - 1 ) / 
-	       sizeof( _roundsize ) ) * sizeof( _roundsize );
+      return ( numBytes + alignment - 1 ) & ~( alignment - 1 );
     }
 
-    char * allocate( std::size_t numBytes )
+    static char * alignPtr( char * ptr, std::size_t alignment )
     {
-      std::size_t roundedSize = roundSize( numBytes );
-      if( roundedSize + m_index > m_bufferSize )
+      return reinterpret_cast<char*>( roundSize( reinterpret_cast<uintptr_t>( ptr ), alignment ) );
+    }
+
+    // numBytes is expected to be rounded already by the caller.  The
+    // alignment is applied to the address and so may exceed BlockAlignment.
+    char * allocate( std::size_t numBytes, std::size_t alignment )
+    {
+      std::size_t start = alignPtr( m_buffer + m_index, alignment ) - m_buffer;
+      if( start > m_bufferSize || numBytes > m_bufferSize - start )
 	return 0;
 
-      char * ptrToReturn = &m_buffer[ m_index ];
-      m_index += roundedSize;
+      char * ptrToReturn = &m_buffer[ start ];
+      m_index = start + numBytes;
       return ptrToReturn;
     }
   
     void dispose( AllocImpl& impl )
     {
-      impl.deallocate( m_buffer );
+      impl.deallocate( m_rawBuffer );
     }
 
     ~_memblock()
@@ -77,12 +121,190 @@ namespace ArenaAlloc
     }    
   };
   
-  template< typename AllocatorImpl, typename Derived >
+  // Header of an allocation above an arena's large threshold, obtained
+  // from the allocator implementation on its own rather than carved from
+  // a block.  It sits just before the allocation, a sized deallocate
+  // finds it on the arena's list and gives the memory back.
+  struct _largealloc
+  {
+    _largealloc * m_prev; // large allocations are listed newest first
+    _largealloc * m_next;
+    char * m_rawBuffer; // pointer obtained from the allocator implementation
+    std::size_t m_rawSize;
+    std::size_t m_serial; // position relative to marks
+  };
+  
+  // Reference count policies for the arena shared by copies of an Alloc.
+  // decrement() returns true when the last reference has gone.
+  
+  // The default.  Copying allocators sharing an arena from several threads
+  // requires an external lock.
+  struct _plainRefCount
+  {
+    std::size_t m_count;
+    
+    _plainRefCount(): m_count( 1 ) {}
+    void increment() { ++m_count; }
+    bool decrement() { return --m_count == 0; }
+    std::size_t count() const { return m_count; }
+  };
+  
+#if __cplusplus >= 201103L
+  // Lets allocators sharing an arena be copied and destroyed from any
+  // thread, i.e. when containers are handed to reader threads.  This does
+  // not make allocation itself thread safe.
+  struct _atomicRefCount
+  {
+    std::atomic<std::size_t> m_count;
+    
+    _atomicRefCount(): m_count( 1 ) {}
+    void increment() { m_count.fetch_add( 1, std::memory_order_relaxed ); }
+    bool decrement() { return m_count.fetch_sub( 1, std::memory_order_acq_rel ) == 1; }
+    std::size_t count() const { return m_count.load( std::memory_order_relaxed ); }
+  };
+#endif
+  
+  // No counting at all.  The arena lives until Alloc::releaseArena() is
+  // called on one of the allocators sharing it.
+  struct _noRefCount
+  {
+    void increment() {}
+    bool decrement() { return false; }
+    std::size_t count() const { return 1; }
+  };
+  
+  // Growth policies deciding the size of each new block of an arena.
+  // blockSize() gives the size of the next block, blockAdded() is called
+  // once it has been added.  Requests too large for half of the next
+  // block get a block of their own and do not consult the policy.
+
+  // The default.  Every block is the arena's default size.
+  struct _fixedGrowth
+  {
+    std::size_t blockSize( std::size_t defaultSize ) const { return defaultSize; }
+    void blockAdded( std::size_t ) {}
+  };
+
+  // Starts at the default size and doubles with each block up to
+  // MaxBlockSize, so a small default suits the many arenas which stay
+  // small and an arena filling gigabytes still needs few blocks.
+  template< std::size_t MaxBlockSize = 64UL*1024*1024 >
+  struct _geometricGrowth
+  {
+    std::size_t m_size; // of the next block, 0 before the first
+    
+    _geometricGrowth(): m_size( 0 ) {}
+    
+    std::size_t blockSize( std::size_t defaultSize ) const
+    {
+      return m_size > defaultSize ? m_size : defaultSize;
+    }
+    
+    void blockAdded( std::size_t defaultSize )
+    {
+      std::size_t size = blockSize( defaultSize );
+      m_size = size < MaxBlockSize / 2 ? size * 2 : ( size > MaxBlockSize ? size : MaxBlockSize );
+    }
+  };
+
+#if __cplusplus >= 201103L
+  // Sizes blocks by the recent allocation rate.  A block filled in less
+  // than half of TargetMillis doubles the size of the next one, up to
+  // MaxBlockSize, and one taking more than twice as long halves it, down
+  // to the default size.  Bursts get big blocks and an arena which
+  // settles into slow allocation goes back to small ones.
+  template< std::size_t MaxBlockSize = 64UL*1024*1024, unsigned TargetMillis = 10 >
+  struct _adaptiveGrowth
+  {
+    std::size_t m_size; // of the next block, 0 before the first
+    std::chrono::steady_clock::time_point m_lastBlock;
+    
+    _adaptiveGrowth(): m_size( 0 ) {}
+    
+    std::size_t blockSize( std::size_t defaultSize ) const
+    {
+      return m_size > defaultSize ? m_size : defaultSize;
+    }
+    
+    void blockAdded( std::size_t defaultSize )
+    {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      std::size_t size = blockSize( defaultSize );
+      if( m_size )
+      {
+	// the time since the last block is the time the last block took to fill
+	std::chrono::steady_clock::duration elapsed = now - m_lastBlock;
+	if( elapsed < std::chrono::milliseconds( TargetMillis ) / 2 && size < MaxBlockSize )
+	  size *= 2;
+	else if( elapsed > std::chrono::milliseconds( TargetMillis ) * 2 && size / 2 >= defaultSize )
+	  size /= 2;
+      }
+      m_size = size;
+      m_lastBlock = now;
+    }
+  };
+#endif
+  
+  // Position in an arena returned by mark() and accepted by rewind().
+  // Only valid for the arena which produced it.
+  struct ArenaMark
+  {
+    void * m_block;
+    std::size_t m_index;
+    std::size_t m_numBytesAllocated;
+    std::size_t m_numLargeAllocations;
+    // the state of the recycle and slab arenas at the mark
+    char * m_top; // unused end of the recycle arena's region
+    char * m_topEnd;
+    std::size_t m_numSlabs; // slab pages taken from the blocks
+    std::size_t m_sealedSlabs; // slabs sealed by an enclosing mark
+  };
+  
+#ifdef ARENA_ALLOC_STATS
+  // Detailed statistics of an arena returned by getStats().  Only
+  // gathered when ARENA_ALLOC_STATS is defined, otherwise an arena keeps
+  // just its allocation, deallocation and byte counts.
+  //
+  // reservedBytes is what the arena obtained from its allocator
+  // implementation, usedBytes what has been carved from its blocks
+  // including rounding and alignment padding, and requestedBytes what
+  // was asked for.  A large tailWaste relative to usedBytes suggests a
+  // larger defaultSize, a peakUsedBytes well below the block size a
+  // smaller one.
+  struct ArenaStats
+  {
+    static const std::size_t HistogramBuckets = 64;
+    
+    std::size_t m_numBlocks;
+    std::size_t m_reservedBytes; // block buffers and block headers
+    std::size_t m_headerBytes; // block headers and buffer alignment slack
+    std::size_t m_usedBytes;
+    std::size_t m_peakUsedBytes;
+    std::size_t m_tailWaste; // unused ends of blocks abandoned for a new block
+    std::size_t m_requestedBytes; // total asked for over the arena's life
+    std::size_t m_recycledHits; // allocations reusing freed memory
+    std::size_t m_freshHits; // allocations carved from the blocks
+    std::size_t m_sizeHistogram[ HistogramBuckets ]; // bucket i counts requests of 2^i to 2^(i+1)-1 bytes, 0 in bucket 0
+    std::size_t m_numLargeAllocations; // live allocations above the large threshold
+    std::size_t m_largeBytes; // reserved for them, included in m_reservedBytes
+  };
+#endif
+  
+  // Alignment is the minimum alignment of every allocation made from the
+  // arena and must be a power of 2.  Individual allocations may request
+  // a stricter alignment.  GrowthPolicy sizes the arena's blocks.
+  template< typename AllocatorImpl, typename Derived, std::size_t Alignment = sizeof( _roundsize ),
+	    typename RefCountPolicy = _plainRefCount, typename GrowthPolicy = _fixedGrowth >
   struct _memblockimplbase
   {
+#if __cplusplus >= 201103L
+    static_assert( Alignment && !( Alignment & ( Alignment - 1 ) ), "Alignment must be a power of 2" );
+#endif
+
     AllocatorImpl m_alloc;
-    std::size_t m_refCount; // when refs -> 0 delete this
+    RefCountPolicy m_refCount; // when refs -> 0 delete this
     std::size_t m_defaultSize;
+    GrowthPolicy m_growth;
         
     std::size_t m_numAllocate; // number of times allocate called
     std::size_t m_numDeallocate; // number of time deallocate called
@@ -90,6 +312,24 @@ namespace ArenaAlloc
     
     _memblock<AllocatorImpl> * m_head;
     _memblock<AllocatorImpl> * m_current;
+    
+    std::size_t m_largeThreshold; // allocations of more bytes bypass the blocks
+    std::size_t m_numLargeAllocations; // ever made, the serial of the next
+    _largealloc * m_large;
+
+#ifdef ARENA_ALLOC_STATS
+    std::size_t m_usedBytes;
+    std::size_t m_peakUsedBytes;
+    std::size_t m_requestedBytes;
+    std::size_t m_recycledHits;
+    std::size_t m_freshHits;
+    std::size_t m_sizeHistogram[ ArenaStats::HistogramBuckets ];
+#endif
+
+#ifdef ARENA_ALLOC_REGISTRY
+    std::size_t m_reservedBytes; // block buffers and block headers
+    _registryEntry m_registryEntry;
+#endif
 
     // round up 2 next power of 2 if not already
     // a power of 2
@@ -116,14 +356,31 @@ namespace ArenaAlloc
 
     _memblockimplbase( std::size_t defaultSize, AllocatorImpl& allocator ):
       m_alloc( allocator ),
-      m_refCount( 1 ),
       m_defaultSize( defaultSize ),
       m_numAllocate( 0 ),
       m_numDeallocate( 0 ),
       m_numBytesAllocated( 0 ),
       m_head( 0 ),
-      m_current( 0 )
+      m_current( 0 ),
+      m_largeThreshold( std::numeric_limits<std::size_t>::max() ),
+      m_numLargeAllocations( 0 ),
+      m_large( 0 )
     {      
+#ifdef ARENA_ALLOC_STATS
+      m_usedBytes = m_peakUsedBytes = m_requestedBytes = m_recycledHits = m_freshHits = 0;
+      for( std::size_t i = 0; i < ArenaStats::HistogramBuckets; i++ )
+	m_sizeHistogram[i] = 0;
+#endif
+      
+#ifdef ARENA_ALLOC_REGISTRY
+      m_reservedBytes = 0;
+      m_registryEntry.m_numAllocate = &m_numAllocate;
+      m_registryEntry.m_numDeallocate = &m_numDeallocate;
+      m_registryEntry.m_numBytesAllocated = &m_numBytesAllocated;
+      m_registryEntry.m_reservedBytes = &m_reservedBytes;
+      ArenaRegistry::add( &m_registryEntry );
+#endif
+      
       if( m_defaultSize < 256 )
       {
 	m_defaultSize = 256; // anything less is academic. a more practical size is 4k or more
@@ -137,38 +394,191 @@ namespace ArenaAlloc
       // for convenience block size should be a power of 2
       // round up to next power of 2
       m_defaultSize = roundpow2( m_defaultSize );
-      allocateNewBlock( m_defaultSize );      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceCreate, this, m_defaultSize, 0 );
+#endif
+      allocateNewBlock( m_growth.blockSize( m_defaultSize ) );
+      m_growth.blockAdded( m_defaultSize );
+    }
+    
+#if defined( ARENA_ALLOC_REGISTRY ) || defined( ARENA_ALLOC_TRACE )
+    ~_memblockimplbase()
+    {
+#ifdef ARENA_ALLOC_REGISTRY
+      ArenaRegistry::remove( &m_registryEntry );
+#endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceDestroy, this, 0, 0 );
+#endif
+    }
+#endif
+    
+#ifdef ARENA_ALLOC_REGISTRY
+    // the label the arena is reported under.  it must outlive the arena,
+    // i.e. a string literal.
+    void setLabel( const char * label )
+    {
+      m_registryEntry.m_label.store( label, std::memory_order_relaxed );
+    }
+#endif
+    
+    // Allocations of more than numBytes are obtained from the allocator
+    // implementation one at a time rather than from the blocks, and a
+    // deallocate given their size returns them to it at once.  Off by
+    // default.  Set it before allocating, a large allocation deallocated
+    // under a threshold raised since stays until a rewind or reset.
+    void setLargeThreshold( std::size_t numBytes )
+    {
+      m_largeThreshold = numBytes;
     }
         
-    char * allocate( std::size_t numBytes )
+    char * allocate( std::size_t numBytes, std::size_t alignment = Alignment )
     {
-      char * ptrToReturn = m_current->allocate( numBytes );
-      if( !ptrToReturn )
-      {
-	allocateNewBlock( numBytes > m_defaultSize / 2 ? roundpow2( numBytes*2 ) : 
-			  m_defaultSize );
-	
-	ptrToReturn = m_current->allocate( numBytes );	
-      }
+      char * ptrToReturn = numBytes > m_largeThreshold ? allocateLarge( numBytes, alignment ) :
+	allocateFromBlocks( numBytes, alignment );
       
 #ifdef ARENA_ALLOC_DEBUG
       fprintf( stdout, "_memblockimpl=%p allocated %ld bytes at address=%p\n", this, numBytes, ptrToReturn );
 #endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceAllocate, this, numBytes, ptrToReturn );
+#endif
 
       ++ m_numAllocate;
       m_numBytesAllocated += numBytes; // does not account for the small overhead in tracking the allocation
+#ifdef ARENA_ALLOC_STATS
+      recordRequest( numBytes );
+      ++ m_freshHits;
+#endif
+      
+      return ptrToReturn;
+    }
+    
+    // bump allocation from the blocks without updating the statistics.
+    // derived implementations carving out regions of their own use this
+    // and keep the statistics themselves.
+    char * allocateFromBlocks( std::size_t numBytes, std::size_t alignment = Alignment )
+    {
+      if( alignment < Alignment )
+	alignment = Alignment;
+      
+      std::size_t roundedSize = _memblock<AllocatorImpl>::roundSize( numBytes, Alignment );
+#ifdef ARENA_ALLOC_STATS
+      _memblock<AllocatorImpl> * before = m_current;
+      std::size_t beforeIndex = m_current->m_index;
+#endif
+      char * ptrToReturn = m_current->allocate( roundedSize, alignment );
+      if( !ptrToReturn && m_current->m_next )
+      {
+	// blocks kept after a rewind are reused before allocating new ones
+	ptrToReturn = m_current->m_next->allocate( roundedSize, alignment );
+	if( ptrToReturn )
+	  m_current = m_current->m_next;
+      }
+      
+      if( !ptrToReturn )
+      {
+	// a fresh block is only cache line aligned so leave room for padding
+	// when a stricter alignment is requested.
+	std::size_t required = roundedSize;
+	if( alignment > _memblock<AllocatorImpl>::BlockAlignment )
+	  required += alignment;
+	
+	std::size_t blockSize = m_growth.blockSize( m_defaultSize );
+	if( required > blockSize / 2 )
+	{
+	  allocateNewBlock( roundpow2( required*2 ) );
+	}
+	else
+	{
+	  allocateNewBlock( blockSize );
+	  m_growth.blockAdded( m_defaultSize );
+	}
+	
+	ptrToReturn = m_current->allocate( roundedSize, alignment );
+      }
+      
+#ifdef ARENA_ALLOC_STATS
+      // the tail of a block left behind counts as waste, not usage
+      m_usedBytes += m_current == before ? m_current->m_index - beforeIndex : m_current->m_index;
+      if( m_usedBytes > m_peakUsedBytes )
+	m_peakUsedBytes = m_usedBytes;
+#endif
       
       return ptrToReturn;
     }
     
+    char * allocateLarge( std::size_t numBytes, std::size_t alignment )
+    {
+      if( alignment < _memblock<AllocatorImpl>::BlockAlignment )
+	alignment = _memblock<AllocatorImpl>::BlockAlignment;
+      
+      // the header goes in the padding before the aligned allocation
+      std::size_t rawSize = sizeof( _largealloc ) + alignment - 1 + numBytes;
+      char * rawBuffer = reinterpret_cast<char*>( m_alloc.allocate( rawSize ) );
+      char * ptrToReturn = _memblock<AllocatorImpl>::alignPtr( rawBuffer + sizeof( _largealloc ), alignment );
+      
+      _largealloc * large = reinterpret_cast<_largealloc*>( ptrToReturn ) - 1;
+      large->m_prev = 0;
+      large->m_next = m_large;
+      large->m_rawBuffer = rawBuffer;
+      large->m_rawSize = rawSize;
+      large->m_serial = m_numLargeAllocations++;
+      if( m_large )
+	m_large->m_prev = large;
+      m_large = large;
+#ifdef ARENA_ALLOC_REGISTRY
+      m_reservedBytes += rawSize;
+#endif
+      
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_memblockimplbase=%p allocating a large allocation of size=%ld\n", this, rawSize );
+#endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceNewBlock, this, rawSize, ptrToReturn );
+#endif
+      return ptrToReturn;
+    }
+    
+    void releaseLarge( _largealloc * large )
+    {
+      if( large->m_prev )
+	large->m_prev->m_next = large->m_next;
+      else
+	m_large = large->m_next;
+      if( large->m_next )
+	large->m_next->m_prev = large->m_prev;
+      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceReleaseBlock, this, large->m_rawSize, large + 1 );
+#endif
+#ifdef ARENA_ALLOC_REGISTRY
+      m_reservedBytes -= large->m_rawSize;
+#endif
+      m_alloc.deallocate( large->m_rawBuffer );
+    }
+    
+    // alignment of the start of every block.  Derived implementations
+    // may hide it with a stricter one.
+    static std::size_t blockAlignment()
+    {
+      return _memblock<AllocatorImpl>::BlockAlignment;
+    }
+    
     void allocateNewBlock( std::size_t blockSize )
     {      
       _memblock<AllocatorImpl> * newBlock = new ( m_alloc.allocate( sizeof( _memblock<AllocatorImpl> ) ) )
-	_memblock<AllocatorImpl>( blockSize, m_alloc );
+	_memblock<AllocatorImpl>( blockSize, m_alloc, Derived::blockAlignment() );
+#ifdef ARENA_ALLOC_REGISTRY
+      m_reservedBytes += newBlock->m_rawSize + sizeof( _memblock<AllocatorImpl> );
+#endif
 						  
 #ifdef ARENA_ALLOC_DEBUG
       fprintf( stdout, "_memblockimplbase=%p allocating a new block of size=%ld\n", this, blockSize );
 #endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceNewBlock, this, blockSize, newBlock->m_buffer );
+#endif
       
       if( m_head == 0 )
       {
@@ -176,52 +586,325 @@ namespace ArenaAlloc
       }
       else
       {
+	// insert after the current block ahead of any blocks retained for reuse
+	newBlock->m_next = m_current->m_next;
 	m_current->m_next = newBlock;
 	m_current = newBlock;
       }      
     }    
     
-    void deallocate( void * ptr )
+    ArenaMark mark() const
+    {
+      ArenaMark mark;
+      mark.m_block = m_current;
+      mark.m_index = m_current->m_index;
+      mark.m_numBytesAllocated = m_numBytesAllocated;
+      mark.m_numLargeAllocations = m_numLargeAllocations;
+      mark.m_top = mark.m_topEnd = 0;
+      mark.m_numSlabs = mark.m_sealedSlabs = 0;
+      return mark;
+    }
+    
+    // whether ptr lies in memory allocated from the blocks before the mark
+    // was taken, i.e. memory a rewind to it keeps.
+    bool precedes( const void * ptr, const ArenaMark& mark ) const
+    {
+      const char * p = reinterpret_cast<const char*>( ptr );
+      for( _memblock<AllocatorImpl> * block = m_head; block; block = block->m_next )
+      {
+	std::size_t used = block == mark.m_block ? mark.m_index : block->m_bufferSize;
+	if( p >= block->m_buffer && p < block->m_buffer + used )
+	  return true;
+	
+	if( block == mark.m_block )
+	  break;
+      }
+      return false;
+    }
+    
+    // whether the mark lies at or before the current position.  A mark
+    // taken after it, i.e. one discarded by rewinding to an earlier mark
+    // first, is misuse and must not be rewound to.
+    bool validMark( const ArenaMark& mark ) const
+    {
+      for( _memblock<AllocatorImpl> * block = m_head; block; block = block->m_next )
+      {
+	if( block == mark.m_block && ( block != m_current || mark.m_index <= block->m_index ) )
+	  return true;
+	
+	if( block == m_current )
+	  break;
+      }
+      
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_memblockimplbase=%p ignoring rewind to a mark past the current position\n", this );
+#endif
+      return false;
+    }
+    
+    // Discards everything allocated after the mark was taken.  The blocks
+    // added since then stay chained and are reused by later allocations so
+    // a mark/rewind cycle reaches a steady state with no allocator calls.
+    // Large allocations made since are given back.  A mark past the
+    // current position is ignored.
+    void rewind( const ArenaMark& mark )
+    {
+      if( !validMark( mark ) )
+	return;
+      
+      while( m_large && m_large->m_serial >= mark.m_numLargeAllocations )
+	releaseLarge( m_large );
+      
+      _memblock<AllocatorImpl> * block = static_cast< _memblock<AllocatorImpl>* >( mark.m_block );
+      
+      for( _memblock<AllocatorImpl> * curr = block; curr != m_current; )
+      {
+	curr = curr->m_next;
+	curr->m_index = 0;
+      }
+      
+      block->m_index = mark.m_index;
+      m_current = block;
+      m_numBytesAllocated = mark.m_numBytesAllocated;
+#ifdef ARENA_ALLOC_STATS
+      m_usedBytes = 0;
+      for( _memblock<AllocatorImpl> * curr = m_head; curr != m_current->m_next; curr = curr->m_next )
+	m_usedBytes += curr->m_index;
+#endif
+      
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_memblockimplbase=%p rewound to block=%p index=%ld\n", this, block, mark.m_index );
+#endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceRewind, this, mark.m_index, block->m_buffer );
+#endif
+    }
+    
+    // Rewinds every block to empty keeping the chain for reuse so the
+    // arena can be refilled without allocator calls.  Buffer space beyond
+    // maxRetainedBytes is given back to the allocator implementation.  The
+    // first block is always retained.  Large allocations are given back.
+    // Outstanding marks become invalid.
+    void reset( std::size_t maxRetainedBytes = std::numeric_limits<std::size_t>::max() )
+    {
+      while( m_large )
+	releaseLarge( m_large );
+      
+      std::size_t retainedBytes = m_head->m_bufferSize;
+      _memblock<AllocatorImpl> * last = m_head;
+      m_head->m_index = 0;
+      
+      while( last->m_next )
+      {
+	_memblock<AllocatorImpl> * curr = last->m_next;
+	if( retainedBytes <= maxRetainedBytes && curr->m_bufferSize <= maxRetainedBytes - retainedBytes )
+	{
+	  retainedBytes += curr->m_bufferSize;
+	  curr->m_index = 0;
+	  last = curr;
+	}
+	else
+	{
+	  last->m_next = curr->m_next;
+	  releaseBlock( curr );
+	}
+      }
+      
+      m_current = m_head;
+      m_numBytesAllocated = 0;
+#ifdef ARENA_ALLOC_STATS
+      m_usedBytes = 0;
+#endif
+      
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_memblockimplbase=%p reset retaining %ld bytes\n", this, retainedBytes );
+#endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceReset, this, retainedBytes, 0 );
+#endif
+    }
+    
+    // memory from the blocks is only reclaimed with the arena, except the
+    // last allocation made, which is taken back off the current block
+    // when it is deallocated with its size, i.e. a temporary freed at
+    // once.  Large allocations go back as soon as they are deallocated
+    // with their size.  They are looked up on the list, newest first as
+    // a growing vector frees them, so memory not allocated as large by
+    // this arena, i.e. of another arena deallocated here through
+    // CurrentAlloc, is never read.  The alignment is not needed.
+    void deallocate( void * ptr, std::size_t numBytes = 0, std::size_t = Alignment )
+    {
+      countDeallocation( ptr, numBytes );
+      if( numBytes > m_largeThreshold )
+      {
+	for( _largealloc * large = m_large; large; large = large->m_next )
+	{
+	  if( large + 1 == ptr )
+	  {
+	    releaseLarge( large );
+	    break;
+	  }
+	}
+      }
+      else if( isLast( ptr, numBytes ) )
+      {
+	std::size_t index = reinterpret_cast<char*>( ptr ) - m_current->m_buffer;
+#ifdef ARENA_ALLOC_STATS
+	m_usedBytes -= m_current->m_index - index;
+#endif
+	m_current->m_index = index;
+      }
+    }
+    
+    // Grows or shrinks the allocation of oldBytes at ptr to newBytes in
+    // place.  Only the last allocation made from the current block can
+    // change, and only within the block.  Returns false, leaving the
+    // allocation as it was, otherwise.
+    bool tryExpand( void * ptr, std::size_t oldBytes, std::size_t newBytes )
+    {
+      if( oldBytes > m_largeThreshold || newBytes > m_largeThreshold || !isLast( ptr, oldBytes ) )
+	return false;
+      
+      std::size_t start = reinterpret_cast<char*>( ptr ) - m_current->m_buffer;
+      std::size_t roundedSize = _memblock<AllocatorImpl>::roundSize( newBytes, Alignment );
+      if( roundedSize > m_current->m_bufferSize - start )
+	return false;
+      
+#ifdef ARENA_ALLOC_STATS
+      m_usedBytes += start + roundedSize;
+      m_usedBytes -= m_current->m_index;
+      if( m_usedBytes > m_peakUsedBytes )
+	m_peakUsedBytes = m_usedBytes;
+#endif
+      m_current->m_index = start + roundedSize;
+      if( newBytes > oldBytes )
+	m_numBytesAllocated += newBytes - oldBytes;
+      return true;
+    }
+    
+    // whether the numBytes at ptr end at the current block's next
+    // allocatable byte.  0 bytes is an unknown size.
+    bool isLast( void * ptr, std::size_t numBytes ) const
+    {
+      char * start = reinterpret_cast<char*>( ptr );
+      return numBytes && start >= m_current->m_buffer &&
+	start + _memblock<AllocatorImpl>::roundSize( numBytes, Alignment ) == m_current->m_buffer + m_current->m_index;
+    }
+    
+    // updates the statistics only, for derived implementations freeing
+    // memory of their own.
+    void countDeallocation( void * ptr, std::size_t numBytes )
     {
       ++ m_numDeallocate;
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceDeallocate, this, numBytes, ptr );
+#endif
     }
     
     size_t getNumAllocations() { return m_numAllocate; }
     size_t getNumDeallocations() { return m_numDeallocate; }
     size_t getNumBytesAllocated() { return m_numBytesAllocated; }
   
+#ifdef ARENA_ALLOC_STATS
+    // counts a request of numBytes in the histogram.  Implementations
+    // reusing freed memory count their recycled and fresh hits themselves.
+    void recordRequest( std::size_t numBytes )
+    {
+      m_requestedBytes += numBytes;
+      ++ m_sizeHistogram[ numBytes ? 63 - __builtin_clzll( numBytes ) : 0 ];
+    }
+    
+    // the block figures are gathered by walking the blocks
+    ArenaStats getStats() const
+    {
+      ArenaStats stats;
+      stats.m_numBlocks = stats.m_reservedBytes = stats.m_headerBytes = stats.m_tailWaste = 0;
+      stats.m_numLargeAllocations = stats.m_largeBytes = 0;
+      for( _largealloc * large = m_large; large; large = large->m_next )
+      {
+	++ stats.m_numLargeAllocations;
+	stats.m_largeBytes += large->m_rawSize;
+      }
+      stats.m_reservedBytes = stats.m_largeBytes;
+      
+      bool beforeCurrent = true;
+      for( _memblock<AllocatorImpl> * block = m_head; block; block = block->m_next )
+      {
+	std::size_t headerBytes = sizeof( _memblock<AllocatorImpl> ) + ( block->m_rawSize - block->m_bufferSize );
+	++ stats.m_numBlocks;
+	stats.m_reservedBytes += block->m_bufferSize + headerBytes;
+	stats.m_headerBytes += headerBytes;
+	
+	if( block == m_current )
+	  beforeCurrent = false;
+	else if( beforeCurrent )
+	  stats.m_tailWaste += block->m_bufferSize - block->m_index;
+      }
+      
+      stats.m_usedBytes = m_usedBytes;
+      stats.m_peakUsedBytes = m_peakUsedBytes;
+      stats.m_requestedBytes = m_requestedBytes;
+      stats.m_recycledHits = m_recycledHits;
+      stats.m_freshHits = m_freshHits;
+      for( std::size_t i = 0; i < ArenaStats::HistogramBuckets; i++ )
+	stats.m_sizeHistogram[i] = m_sizeHistogram[i];
+      
+      return stats;
+    }
+#endif
+  
     void clear()
     {
+      while( m_large )
+	releaseLarge( m_large );
+      
       _memblock<AllocatorImpl> * block = m_head;
       while( block )
       {
 	_memblock<AllocatorImpl> * curr = block;
 	block = block->m_next;
-	curr->dispose( m_alloc );
-	curr->~_memblock<AllocatorImpl>();
-	m_alloc.deallocate( curr );
+	releaseBlock( curr );
       }      
     }    
+    
+    void releaseBlock( _memblock<AllocatorImpl> * block )
+    {
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceReleaseBlock, this, block->m_bufferSize, block->m_buffer );
+#endif
+#ifdef ARENA_ALLOC_REGISTRY
+      m_reservedBytes -= block->m_rawSize + sizeof( *block );
+#endif
+      block->dispose( m_alloc );
+      block->~_memblock<AllocatorImpl>();
+      m_alloc.deallocate( block );
+    }
 
-    // The ref counting model does not permit the sharing of 
-    // this object across multiple threads unless an external locking mechanism is applied 
-    // to ensure the atomicity of the reference count.  
+    // Whether copies of allocators sharing this object may be made on
+    // several threads is down to the reference count policy.  Allocation
+    // itself is never thread safe.
     void incrementRefCount() 
     { 
-      ++m_refCount; 
+      m_refCount.increment(); 
 #ifdef ARENA_ALLOC_DEBUG
-      fprintf( stdout, "ref count on _memblockimplbase=%p incremented to %ld\n", this, m_refCount );
+      fprintf( stdout, "ref count on _memblockimplbase=%p incremented to %ld\n", this, m_refCount.count() );
 #endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceRefIncrement, this, m_refCount.count(), 0 );
+#endif
     }
 
     void decrementRefCount()
     {
-      --m_refCount;
+      bool last = m_refCount.decrement();
 #ifdef ARENA_ALLOC_DEBUG
-      fprintf( stdout, "ref count on _memblockimplbase=%p decremented to %ld\n", this, m_refCount );
+      fprintf( stdout, "ref count on _memblockimplbase=%p decremented to %ld\n", this, m_refCount.count() );
 #endif      
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceRefDecrement, this, m_refCount.count(), 0 );
+#endif
       
-      if( m_refCount == 0 )
+      if( last )
       {
 	Derived::destroy( static_cast<Derived*>(this) );
       }
@@ -235,13 +918,16 @@ namespace ArenaAlloc
   // This object is instantiated in space obtained from the allocator
   // implementation. The allocator implementation is the component
   // on which allocate/deallocate are called to obtain storage from.
-  template< typename AllocatorImpl >
-  struct _memblockimpl : public _memblockimplbase<AllocatorImpl, _memblockimpl<AllocatorImpl> >
+  template< typename AllocatorImpl, std::size_t Alignment = sizeof( _roundsize ),
+	    typename RefCountPolicy = _plainRefCount, typename GrowthPolicy = _fixedGrowth >
+  struct _memblockimpl : 
+    public _memblockimplbase<AllocatorImpl, _memblockimpl<AllocatorImpl, Alignment, RefCountPolicy, GrowthPolicy>,
+			     Alignment, RefCountPolicy, GrowthPolicy >
   {     
   private:
 
-    typedef struct _memblockimplbase< AllocatorImpl, _memblockimpl<AllocatorImpl> > base_t;
-    friend struct _memblockimplbase< AllocatorImpl, _memblockimpl<AllocatorImpl> >;
+    typedef struct _memblockimplbase< AllocatorImpl, _memblockimpl, Alignment, RefCountPolicy, GrowthPolicy > base_t;
+    friend struct _memblockimplbase< AllocatorImpl, _memblockimpl, Alignment, RefCountPolicy, GrowthPolicy >;
     
     // to get around some sticky access issues between Alloc<T1> and Alloc<T2> when sharing
     // the implementation.
@@ -249,24 +935,26 @@ namespace ArenaAlloc
     friend class Alloc;
     
     template< typename T >
-    static void assign( const Alloc<T,AllocatorImpl, _memblockimpl<AllocatorImpl> >& src, 
-			  _memblockimpl *& dest );
+    static void assign( const Alloc<T,AllocatorImpl, _memblockimpl >& src, 
+			  _memblockimpl *& dest )
+    {
+      dest = const_cast< _memblockimpl* >( src.m_impl );
+    }
         
-    static _memblockimpl<AllocatorImpl> * create( size_t defaultSize, AllocatorImpl& alloc )
+    static _memblockimpl * create( size_t defaultSize, AllocatorImpl& alloc )
     {
-      return new ( alloc.allocate( sizeof( _memblockimpl ) ) ) _memblockimpl<AllocatorImpl>( defaultSize, 
-											     alloc );
+      return new ( alloc.allocate( sizeof( _memblockimpl ) ) ) _memblockimpl( defaultSize, alloc );
     }
    
-    static void destroy( _memblockimpl<AllocatorImpl> * objToDestroy )
+    static void destroy( _memblockimpl * objToDestroy )
     {      
       AllocatorImpl allocImpl = objToDestroy->m_alloc;
-      objToDestroy-> ~_memblockimpl<AllocatorImpl>();
+      objToDestroy-> ~_memblockimpl();
       allocImpl.deallocate( objToDestroy );      
     }
     
     _memblockimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
-      _memblockimplbase<AllocatorImpl, _memblockimpl<AllocatorImpl> >( defaultSize, allocImpl )
+      base_t( defaultSize, allocImpl )
     {
 #ifdef ARENA_ALLOC_DEBUG
       fprintf( stdout, "_memblockimpl=%p constructed with default size=%ld\n", this, 
@@ -0,0 +1,184 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  arenaregistry.h
+ **
+ **  Process wide registry of arenas for telemetry.  Compiled in when
+ **  ARENA_ALLOC_REGISTRY is defined, in which case arenaallocimpl.h
+ **  includes it and every arena built on _memblockimplbase registers
+ **  itself on creation and deregisters on destruction.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _ARENA_REGISTRY_H
+#define _ARENA_REGISTRY_H
+
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <string>
+#include <ostream>
+#include <cstddef>
+
+namespace ArenaAlloc
+{
+
+  // Registration of one arena, a member of the arena itself.  The
+  // counters are the arena's own, read without synchronising with the
+  // thread allocating from it.
+  struct _registryEntry
+  {
+    std::atomic<const char*> m_label;
+    const std::size_t * m_numAllocate;
+    const std::size_t * m_numDeallocate;
+    const std::size_t * m_numBytesAllocated;
+    const std::size_t * m_reservedBytes;
+    _registryEntry * m_prev;
+    _registryEntry * m_next;
+
+    _registryEntry(): m_label( "unlabelled" ), m_prev( 0 ), m_next( 0 ) {}
+
+    // a racy but tear free read of a counter the owning thread updates
+    // with plain stores.  ThreadSanitizer reports it as a race.
+    static std::size_t read( const std::size_t * counter )
+    {
+      return __atomic_load_n( counter, __ATOMIC_RELAXED );
+    }
+  };
+
+  // Totals over a set of arenas.
+  struct ArenaTotals
+  {
+    std::size_t m_numArenas;
+    std::size_t m_numAllocations;
+    std::size_t m_numDeallocations;
+    std::size_t m_bytesAllocated; // as counted by getNumBytesAllocated()
+    std::size_t m_reservedBytes; // blocks and block headers obtained from the allocator implementations
+
+    ArenaTotals(): m_numArenas( 0 ), m_numAllocations( 0 ), m_numDeallocations( 0 ),
+		   m_bytesAllocated( 0 ), m_reservedBytes( 0 ) {}
+  };
+
+  struct RegistrySnapshot
+  {
+    ArenaTotals m_totals;
+    std::map< std::string, ArenaTotals > m_byLabel;
+  };
+
+  // The registry.  snapshot() holds the registry's lock only, which
+  // arenas take when they are created and destroyed, so allocation
+  // carries on throughout.  The figures of arenas busy allocating are
+  // a moment out of date and not mutually consistent.
+  struct ArenaRegistry
+  {
+    static std::mutex& mutex()
+    {
+      static std::mutex s_mutex;
+      return s_mutex;
+    }
+
+    static _registryEntry *& head()
+    {
+      static _registryEntry * s_head = 0;
+      return s_head;
+    }
+
+    static void add( _registryEntry * entry )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      entry->m_prev = 0;
+      entry->m_next = head();
+      if( head() )
+	head()->m_prev = entry;
+      head() = entry;
+    }
+
+    static void remove( _registryEntry * entry )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      if( entry->m_prev )
+	entry->m_prev->m_next = entry->m_next;
+      else
+	head() = entry->m_next;
+
+      if( entry->m_next )
+	entry->m_next->m_prev = entry->m_prev;
+    }
+
+    static RegistrySnapshot snapshot()
+    {
+      RegistrySnapshot result;
+      std::lock_guard<std::mutex> lock( mutex() );
+      for( _registryEntry * entry = head(); entry; entry = entry->m_next )
+      {
+	ArenaTotals * totals[2] = { &result.m_totals,
+				    &result.m_byLabel[ entry->m_label.load( std::memory_order_relaxed ) ] };
+	for( int i = 0; i < 2; i++ )
+	{
+	  ++ totals[i]->m_numArenas;
+	  totals[i]->m_numAllocations += _registryEntry::read( entry->m_numAllocate );
+	  totals[i]->m_numDeallocations += _registryEntry::read( entry->m_numDeallocate );
+	  totals[i]->m_bytesAllocated += _registryEntry::read( entry->m_numBytesAllocated );
+	  totals[i]->m_reservedBytes += _registryEntry::read( entry->m_reservedBytes );
+	}
+      }
+
+      return result;
+    }
+
+    // one line per label then the totals, i.e.
+    //   label=cache arenas=12 allocations=... deallocations=... bytesAllocated=... reservedBytes=...
+    static void dumpText( std::ostream& out )
+    {
+      RegistrySnapshot snap = snapshot();
+      for( std::map< std::string, ArenaTotals >::const_iterator itr = snap.m_byLabel.begin();
+	   itr != snap.m_byLabel.end(); ++itr )
+	writeText( out, itr->first, itr->second );
+      writeText( out, "total", snap.m_totals );
+    }
+
+    // {"total":{...},"labels":{"cache":{...},...}}
+    static void dumpJson( std::ostream& out )
+    {
+      RegistrySnapshot snap = snapshot();
+      out << "{\"total\":";
+      writeJson( out, snap.m_totals );
+      out << ",\"labels\":{";
+      for( std::map< std::string, ArenaTotals >::const_iterator itr = snap.m_byLabel.begin();
+	   itr != snap.m_byLabel.end(); ++itr )
+      {
+	if( itr != snap.m_byLabel.begin() )
+	  out << ",";
+	out << "\"";
+	for( std::size_t i = 0; i < itr->first.size(); i++ )
+	{
+	  char c = itr->first[i];
+	  if( c == '"' || c == '\\' )
+	    out << '\\';
+	  out << c;
+	}
+	out << "\":";
+	writeJson( out, itr->second );
+      }
+      out << "}}\n";
+    }
+
+  private:
+
+    static void writeText( std::ostream& out, const std::string& label, const ArenaTotals& totals )
+    {
+      out << "label=" << label << " arenas=" << totals.m_numArenas
+	  << " allocations=" << totals.m_numAllocations << " deallocations=" << totals.m_numDeallocations
+	  << " bytesAllocated=" << totals.m_bytesAllocated << " reservedBytes=" << totals.m_reservedBytes << "\n";
+    }
+
+    static void writeJson( std::ostream& out, const ArenaTotals& totals )
+    {
+      out << "{\"arenas\":" << totals.m_numArenas
+	  << ",\"allocations\":" << totals.m_numAllocations << ",\"deallocations\":" << totals.m_numDeallocations
+	  << ",\"bytesAllocated\":" << totals.m_bytesAllocated << ",\"reservedBytes\":" << totals.m_reservedBytes << "}";
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  arenatrace.h
+ **
+ **  Binary event tracing of arenas.  Compiled in when ARENA_ALLOC_TRACE
+ **  is defined, in which case arenaallocimpl.h includes it and the arenas
+ **  record an event wherever ARENA_ALLOC_DEBUG would print.  Each thread
+ **  writes fixed size events into a ring buffer of its own with no
+ **  locking, keeping the most recent ARENA_ALLOC_TRACE_EVENTS of them.
+ **  ArenaTrace::write() saves every thread's events to a file which
+ **  tracedecode.cpp turns into timelines and lifetimes.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _ARENA_TRACE_H
+#define _ARENA_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+// events kept per thread, a power of 2
+#ifndef ARENA_ALLOC_TRACE_EVENTS
+#define ARENA_ALLOC_TRACE_EVENTS 65536
+#endif
+
+namespace ArenaAlloc
+{
+
+  enum TraceOp
+  {
+    TraceCreate = 1, // size is the default block size
+    TraceDestroy,
+    TraceAllocate, // size requested, address returned
+    TraceDeallocate, // size as passed to deallocate, 0 if unknown
+    TraceNewBlock, // size of the block
+    TraceReleaseBlock,
+    TraceRewind, // address of the block rewound to, size the index within it
+    TraceReset, // size retained
+    TraceRefIncrement, // size is the new count
+    TraceRefDecrement
+  };
+
+  // 32 bytes.  Sizes of 4GB or more are recorded as 0xffffffff.
+  struct TraceEvent
+  {
+    uint64_t m_tsc;
+    uint64_t m_arena; // address of the arena's implementation object
+    uint64_t m_address;
+    uint32_t m_size;
+    uint16_t m_op;
+    uint16_t m_thread; // index of the thread's ring
+  };
+
+  // Layout of a trace file: a TraceFileHeader, then for each thread a
+  // TraceRingHeader followed by its events oldest first.
+  struct TraceFileHeader
+  {
+    static const uint64_t Magic = 0x31435254414e5241ULL; // "ARNATRC1"
+
+    uint64_t m_magic;
+    uint32_t m_eventSize;
+    uint32_t m_numRings;
+    double m_ticksPerNs; // for converting timestamps
+  };
+
+  struct TraceRingHeader
+  {
+    uint32_t m_thread;
+    uint32_t m_reserved;
+    uint64_t m_numEvents;
+    uint64_t m_numDropped; // overwritten before the file was written
+  };
+
+  // Ring buffer written by one thread.  m_written only grows and is
+  // published after each event so a reader can tell which events it
+  // copied may have been overwritten meanwhile.
+  struct _traceRing
+  {
+    static const std::size_t Capacity = ARENA_ALLOC_TRACE_EVENTS;
+    static_assert( ( Capacity & ( Capacity - 1 ) ) == 0, "ARENA_ALLOC_TRACE_EVENTS must be a power of 2" );
+
+    uint16_t m_thread;
+    std::atomic<bool> m_inUse; // owned by a live thread
+    std::atomic<uint64_t> m_written;
+    TraceEvent m_events[ Capacity ];
+
+    explicit _traceRing( uint16_t thread ): m_thread( thread ), m_inUse( true ), m_written( 0 ) {}
+
+    void record( uint16_t op, const void * arena, std::size_t size, const void * address, uint64_t tsc )
+    {
+      uint64_t index = m_written.load( std::memory_order_relaxed );
+      TraceEvent& event = m_events[ index & ( Capacity - 1 ) ];
+      event.m_tsc = tsc;
+      event.m_arena = reinterpret_cast<uintptr_t>( arena );
+      event.m_address = reinterpret_cast<uintptr_t>( address );
+      event.m_size = size < 0xffffffffUL ? uint32_t( size ) : 0xffffffffU;
+      event.m_op = op;
+      event.m_thread = m_thread;
+      m_written.store( index + 1, std::memory_order_release );
+    }
+  };
+
+  struct ArenaTrace
+  {
+    static uint64_t timestamp()
+    {
+#if defined( __x86_64__ ) || defined( __i386__ )
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+    }
+
+    static void record( TraceOp op, const void * arena, std::size_t size, const void * address )
+    {
+      ring()->record( op, arena, size, address, timestamp() );
+    }
+
+    // Writes the events of every thread to path, returns false if the
+    // file could not be written.  Threads may keep recording meanwhile,
+    // events overwritten while being copied are dropped.
+    static bool write( const char * path )
+    {
+      FILE * file = fopen( path, "wb" );
+      if( !file )
+	return false;
+
+      std::lock_guard<std::mutex> lock( mutex() );
+      TraceFileHeader header;
+      header.m_magic = TraceFileHeader::Magic;
+      header.m_eventSize = sizeof( TraceEvent );
+      header.m_numRings = rings().size();
+      header.m_ticksPerNs = ticksPerNs();
+      bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+
+      std::vector<TraceEvent> events;
+      for( std::size_t i = 0; i < rings().size(); i++ )
+      {
+	_traceRing * ring = rings()[i];
+	uint64_t end = ring->m_written.load( std::memory_order_acquire );
+	uint64_t begin = end > _traceRing::Capacity ? end - _traceRing::Capacity : 0;
+	events.clear();
+	for( uint64_t index = begin; index < end; index++ )
+	  events.push_back( ring->m_events[ index & ( _traceRing::Capacity - 1 ) ] );
+
+	// events in slots the writer has reached since, including the one
+	// it may be writing now, may be torn
+	uint64_t lapped = ring->m_written.load( std::memory_order_acquire ) + 1;
+	std::size_t skip = lapped > _traceRing::Capacity && lapped - _traceRing::Capacity > begin ?
+	  std::min<uint64_t>( lapped - _traceRing::Capacity - begin, events.size() ) : 0;
+
+	TraceRingHeader ringHeader;
+	ringHeader.m_thread = ring->m_thread;
+	ringHeader.m_reserved = 0;
+	ringHeader.m_numEvents = events.size() - skip;
+	ringHeader.m_numDropped = begin + skip;
+	ok = ok && fwrite( &ringHeader, sizeof( ringHeader ), 1, file ) == 1;
+	if( ringHeader.m_numEvents )
+	  ok = ok && fwrite( &events[ skip ], sizeof( TraceEvent ), ringHeader.m_numEvents, file ) == ringHeader.m_numEvents;
+      }
+
+      return fclose( file ) == 0 && ok;
+    }
+
+  private:
+
+    static std::mutex& mutex()
+    {
+      static std::mutex s_mutex;
+      return s_mutex;
+    }
+
+    // rings live as long as the process, the list is never destroyed so
+    // arenas torn down at exit can still record.  a ring whose thread has
+    // exited is handed to the next new thread, so the rings number no
+    // more than the threads alive at once.
+    static std::vector<_traceRing*>& rings()
+    {
+      static std::vector<_traceRing*> * s_rings = new std::vector<_traceRing*>();
+      return *s_rings;
+    }
+
+    struct _ringOwner
+    {
+      _traceRing * m_ring;
+
+      _ringOwner(): m_ring( 0 )
+      {
+	start();
+	std::lock_guard<std::mutex> lock( mutex() );
+	for( std::size_t i = 0; i < rings().size() && !m_ring; i++ )
+	{
+	  bool inUse = false;
+	  if( rings()[i]->m_inUse.compare_exchange_strong( inUse, true ) )
+	    m_ring = rings()[i];
+	}
+
+	if( !m_ring )
+	{
+	  m_ring = new _traceRing( rings().size() );
+	  rings().push_back( m_ring );
+	}
+      }
+
+      ~_ringOwner()
+      {
+	m_ring->m_inUse.store( false );
+      }
+    };
+
+    static _traceRing * ring()
+    {
+      static thread_local _ringOwner s_owner;
+      return s_owner.m_ring;
+    }
+
+    typedef std::chrono::steady_clock clock_type;
+
+    // when tracing was first used, the start of the calibration of the
+    // timestamps.
+    static const std::pair< clock_type::time_point, uint64_t >& start()
+    {
+      static const std::pair< clock_type::time_point, uint64_t > s_start( clock_type::now(), timestamp() );
+      return s_start;
+    }
+
+    // timestamp ticks per nanosecond measured from the start to now
+    static double ticksPerNs()
+    {
+      clock_type::time_point now = clock_type::now();
+      uint64_t tsc = timestamp();
+      double ns = std::chrono::duration<double, std::nano>( now - start().first ).count();
+      return ns > 0 ? ( tsc - start().second ) / ns : 1.0;
+    }
+  };
+
+}
+
+#endif
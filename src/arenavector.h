@@ -0,0 +1,210 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  arenavector.h
+ **
+ **  Vector growing in place in an arena.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _ARENA_VECTOR_H
+#define _ARENA_VECTOR_H
+
+#include "arenaalloc.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // A vector for arena allocators providing tryExpand().  When it runs
+  // out of room it first asks the arena to extend its buffer in place,
+  // which succeeds while nothing else has been allocated from the arena
+  // since, so a buffer appended to on its own grows without copying and
+  // leaves no outgrown buffers behind.  Only when that fails is a new
+  // buffer allocated and the elements moved, as std::vector would.
+  //
+  // Iterators are pointers and, as with std::vector, are invalidated by
+  // any growth, in place or not.  Copying is not supported, moving is.
+  template< typename T, typename AllocType = Alloc<T> >
+  class ArenaVector
+  {
+    AllocType m_alloc;
+    T * m_data;
+    std::size_t m_size;
+    std::size_t m_capacity;
+
+  public:
+    typedef T value_type;
+    typedef AllocType allocator_type;
+    typedef std::size_t size_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef T& reference;
+    typedef const T& const_reference;
+
+    explicit ArenaVector( const AllocType& alloc ):
+      m_alloc( alloc ),
+      m_data( 0 ),
+      m_size( 0 ),
+      m_capacity( 0 )
+    {
+    }
+
+    ArenaVector( ArenaVector&& other ):
+      m_alloc( other.m_alloc ),
+      m_data( other.m_data ),
+      m_size( other.m_size ),
+      m_capacity( other.m_capacity )
+    {
+      other.m_data = 0;
+      other.m_size = other.m_capacity = 0;
+    }
+
+    ArenaVector& operator = ( ArenaVector&& other )
+    {
+      if( this != &other )
+      {
+	release();
+	m_alloc = other.m_alloc;
+	m_data = other.m_data;
+	m_size = other.m_size;
+	m_capacity = other.m_capacity;
+	other.m_data = 0;
+	other.m_size = other.m_capacity = 0;
+      }
+      return *this;
+    }
+
+    ArenaVector( const ArenaVector& ) = delete;
+    ArenaVector& operator = ( const ArenaVector& ) = delete;
+
+    ~ArenaVector()
+    {
+      release();
+    }
+
+    allocator_type get_allocator() const { return m_alloc; }
+
+    size_type size() const { return m_size; }
+    size_type capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    T * data() { return m_data; }
+    const T * data() const { return m_data; }
+    iterator begin() { return m_data; }
+    iterator end() { return m_data + m_size; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+
+    reference operator [] ( size_type index ) { return m_data[ index ]; }
+    const_reference operator [] ( size_type index ) const { return m_data[ index ]; }
+    reference front() { return m_data[0]; }
+    const_reference front() const { return m_data[0]; }
+    reference back() { return m_data[ m_size - 1 ]; }
+    const_reference back() const { return m_data[ m_size - 1 ]; }
+
+    reference at( size_type index )
+    {
+      if( index >= m_size )
+	throw std::out_of_range( "ArenaVector::at" );
+      return m_data[ index ];
+    }
+
+    const_reference at( size_type index ) const
+    {
+      if( index >= m_size )
+	throw std::out_of_range( "ArenaVector::at" );
+      return m_data[ index ];
+    }
+
+    void push_back( const T& value ) { emplace_back( value ); }
+    void push_back( T&& value ) { emplace_back( std::move( value ) ); }
+
+    template< typename... Args >
+    reference emplace_back( Args&&... args )
+    {
+      if( m_size == m_capacity )
+	grow( m_size + 1 );
+      ::new( static_cast<void*>( m_data + m_size ) ) T( std::forward<Args>( args )... );
+      return m_data[ m_size++ ];
+    }
+
+    void pop_back()
+    {
+      m_data[ --m_size ].~T();
+    }
+
+    void reserve( size_type capacity )
+    {
+      if( capacity > m_capacity )
+	reallocate( capacity );
+    }
+
+    void resize( size_type size )
+    {
+      if( size > m_capacity )
+	grow( size );
+      while( m_size < size )
+	emplace_back();
+      while( m_size > size )
+	pop_back();
+    }
+
+    void clear()
+    {
+      while( m_size )
+	pop_back();
+    }
+
+    // gives capacity beyond the size back to the arena if it can be
+    // taken off the end of the buffer in place
+    void shrink_to_fit()
+    {
+      if( m_capacity > m_size && m_alloc.tryExpand( m_data, m_capacity, m_size ) )
+	m_capacity = m_size;
+    }
+
+  private:
+
+    // at least doubles the capacity like std::vector
+    void grow( size_type required )
+    {
+      reallocate( std::max( required, m_capacity ? m_capacity * 2 : size_type( 8 ) ) );
+    }
+
+    void reallocate( size_type capacity )
+    {
+      if( m_data && m_alloc.tryExpand( m_data, m_capacity, capacity ) )
+      {
+	m_capacity = capacity;
+	return;
+      }
+
+      T * data = m_alloc.allocate( capacity );
+      for( size_type i = 0; i < m_size; i++ )
+      {
+	::new( static_cast<void*>( data + i ) ) T( std::move_if_noexcept( m_data[i] ) );
+	m_data[i].~T();
+      }
+
+      if( m_data )
+	m_alloc.deallocate( m_data, m_capacity );
+      m_data = data;
+      m_capacity = capacity;
+    }
+
+    void release()
+    {
+      clear();
+      if( m_data )
+	m_alloc.deallocate( m_data, m_capacity );
+      m_data = 0;
+      m_capacity = 0;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,281 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  concurrentalloc.h
+ **
+ **  Arena allocator which may be shared by many threads.  Allocation is a
+ **  lock free bump of the current block's cursor.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _CONCURRENT_ALLOC_H
+#define _CONCURRENT_ALLOC_H
+
+#include "arenaalloc.h"
+#include <atomic>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // Block header of the concurrent arena.  The header lives at the start
+  // of the block's own buffer and the statistics share the cache line
+  // of the cursor which an allocating thread owns after its fetch_add
+  // anyway, so keeping them costs no additional coherence traffic.
+  template< typename AllocImpl >
+  struct alignas( 64 ) _concurrentblock
+  {
+    std::atomic<std::size_t> m_index; // next allocatable byte.  may overshoot the end
+    std::atomic<std::size_t> m_numAllocate;
+    std::atomic<std::size_t> m_numDeallocate;
+    std::atomic<std::size_t> m_numBytesAllocated;
+    std::size_t m_bufferSize;
+    char * m_rawBuffer; // pointer obtained from the allocator implementation
+    _concurrentblock * m_next; // previously installed block.  immutable once published
+
+    _concurrentblock( std::size_t bufferSize, char * rawBuffer, std::size_t initialIndex ):
+      m_index( initialIndex ),
+      m_numAllocate( initialIndex ? 1 : 0 ),
+      m_numDeallocate( 0 ),
+      m_numBytesAllocated( 0 ),
+      m_bufferSize( bufferSize ),
+      m_rawBuffer( rawBuffer ),
+      m_next( 0 )
+    {
+    }
+
+    char * buffer() { return reinterpret_cast<char*>( this + 1 ); }
+
+    static _concurrentblock * create( std::size_t bufferSize, std::size_t initialIndex, AllocImpl& allocImpl )
+    {
+      std::size_t rawSize = bufferSize + sizeof( _concurrentblock ) + alignof( _concurrentblock );
+      char * raw = reinterpret_cast<char*>( allocImpl.allocate( rawSize ) );
+      char * aligned = _memblock<AllocImpl>::alignPtr( raw, alignof( _concurrentblock ) );
+      return new ( aligned ) _concurrentblock( bufferSize, raw, initialIndex );
+    }
+
+    void dispose( AllocImpl& allocImpl )
+    {
+      char * raw = m_rawBuffer;
+      this->~_concurrentblock();
+      allocImpl.deallocate( raw );
+    }
+  };
+
+  // Many threads may allocate from one instance.  Each allocation is an
+  // atomic fetch_add on the cursor of the current block.  The thread
+  // whose reservation runs past the end of a block allocates a new one
+  // with its own allocation already carved out and installs it with a
+  // compare and swap.  A thread losing that race gives its block back and
+  // retries against the winner's block.  Blocks are never released before
+  // the arena is destroyed so no reclamation scheme is needed.
+  //
+  // The allocator implementation must itself be thread safe.
+  // _newAllocatorImpl is.  The reference count policy should be
+  // _atomicRefCount or _noRefCount for the same reason.
+  template< typename AllocatorImpl, std::size_t Alignment = sizeof( _roundsize ),
+	    typename RefCountPolicy = _atomicRefCount >
+  struct _concurrentmemblockimpl
+  {
+  private:
+
+    static_assert( Alignment && !( Alignment & ( Alignment - 1 ) ), "Alignment must be a power of 2" );
+
+    typedef _concurrentblock<AllocatorImpl> block_t;
+
+    AllocatorImpl m_alloc;
+    std::size_t m_defaultSize;
+    RefCountPolicy m_refCount; // when refs -> 0 delete this
+    std::atomic<block_t*> m_current;
+    std::atomic<block_t*> m_large; // dedicated blocks of oversized allocations
+
+    // to get around some sticky access issues between Alloc<T1> and Alloc<T2> when sharing
+    // the implementation.
+    template <typename U, typename A, typename M >
+    friend class Alloc;
+
+    template< typename T >
+    static void assign( const Alloc<T,AllocatorImpl, _concurrentmemblockimpl >& src,
+			_concurrentmemblockimpl *& dest )
+    {
+      dest = const_cast< _concurrentmemblockimpl* >( src.m_impl );
+    }
+
+    static _concurrentmemblockimpl * create( std::size_t defaultSize, AllocatorImpl& alloc )
+    {
+      return new ( alloc.allocate( sizeof( _concurrentmemblockimpl ) ) ) _concurrentmemblockimpl( defaultSize, alloc );
+    }
+
+    static void destroy( _concurrentmemblockimpl * objToDestroy )
+    {
+      AllocatorImpl allocImpl = objToDestroy->m_alloc;
+      objToDestroy-> ~_concurrentmemblockimpl();
+      allocImpl.deallocate( objToDestroy );
+    }
+
+    _concurrentmemblockimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
+      m_alloc( allocImpl ),
+      m_defaultSize( defaultSize ),
+      m_current( 0 ),
+      m_large( 0 )
+    {
+      if( m_defaultSize < 256 )
+      {
+	m_defaultSize = 256;
+      }
+      else if ( m_defaultSize > 1024UL*1024*1024*16 )
+      {
+	m_defaultSize = 1024UL*1024*1024*16;
+      }
+
+      m_current.store( block_t::create( m_defaultSize, 0, m_alloc ), std::memory_order_release );
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_concurrentmemblockimpl=%p constructed with default size=%ld\n", this,
+	       m_defaultSize );
+#endif
+    }
+
+    ~_concurrentmemblockimpl()
+    {
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "~_concurrentmemblockimpl() called on _concurrentmemblockimpl=%p\n", this );
+#endif
+      releaseBlocks( m_current.load( std::memory_order_acquire ) );
+      releaseBlocks( m_large.load( std::memory_order_acquire ) );
+    }
+
+    void releaseBlocks( block_t * block )
+    {
+      while( block )
+      {
+	block_t * curr = block;
+	block = block->m_next;
+	curr->dispose( m_alloc );
+      }
+    }
+
+    static char * alignedStart( block_t * block, std::size_t start, std::size_t alignment )
+    {
+      return _memblock<AllocatorImpl>::alignPtr( block->buffer() + start, alignment );
+    }
+
+  public:
+
+    char * allocate( std::size_t numBytes, std::size_t alignment = Alignment )
+    {
+      if( alignment < Alignment )
+	alignment = Alignment;
+
+      // block buffers are cache line aligned, every reservation is a multiple
+      // of Alignment so only stricter alignments need padding.
+      std::size_t reserve = _memblock<AllocatorImpl>::roundSize( numBytes, Alignment );
+      if( alignment > Alignment )
+	reserve += alignment - Alignment;
+
+      if( reserve > m_defaultSize / 2 )
+	return allocateLarge( numBytes, reserve, alignment );
+
+      block_t * block = m_current.load( std::memory_order_acquire );
+      for( ;; )
+      {
+	std::size_t start = block->m_index.fetch_add( reserve, std::memory_order_relaxed );
+	if( start + reserve <= block->m_bufferSize )
+	{
+	  block->m_numAllocate.fetch_add( 1, std::memory_order_relaxed );
+	  block->m_numBytesAllocated.fetch_add( numBytes, std::memory_order_relaxed );
+	  return alignedStart( block, start, alignment );
+	}
+
+	// block exhausted.  pick up a block installed by another thread
+	// otherwise try to install a new one with this allocation already
+	// reserved at its start.
+	block_t * latest = m_current.load( std::memory_order_acquire );
+	if( latest != block )
+	{
+	  block = latest;
+	  continue;
+	}
+
+	block_t * newBlock = block_t::create( m_defaultSize, reserve, m_alloc );
+	newBlock->m_numBytesAllocated.store( numBytes, std::memory_order_relaxed );
+	newBlock->m_next = block;
+
+	if( m_current.compare_exchange_strong( block, newBlock,
+					       std::memory_order_acq_rel, std::memory_order_acquire ) )
+	{
+#ifdef ARENA_ALLOC_DEBUG
+	  fprintf( stdout, "_concurrentmemblockimpl=%p installed a new block of size=%ld\n", this, m_defaultSize );
+#endif
+	  return alignedStart( newBlock, 0, alignment );
+	}
+
+	// another thread installed a block first.  block now holds its block.
+	newBlock->dispose( m_alloc );
+      }
+    }
+
+    // nothing is reclaimed, the deallocation is counted against the
+    // current block.  acquire as in allocate, the block may be new.
+    void deallocate( void *, std::size_t = 0, std::size_t = Alignment )
+    {
+      m_current.load( std::memory_order_acquire )->m_numDeallocate.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    std::size_t getNumAllocations() { return sum( &block_t::m_numAllocate ); }
+    std::size_t getNumDeallocations() { return sum( &block_t::m_numDeallocate ); }
+    std::size_t getNumBytesAllocated() { return sum( &block_t::m_numBytesAllocated ); }
+
+    void incrementRefCount()
+    {
+      m_refCount.increment();
+    }
+
+    void decrementRefCount()
+    {
+      if( m_refCount.decrement() )
+	destroy( this );
+    }
+
+  private:
+
+    // oversized allocations get a dedicated block which is pushed onto
+    // its own list leaving the current block undisturbed.
+    char * allocateLarge( std::size_t numBytes, std::size_t reserve, std::size_t alignment )
+    {
+      block_t * newBlock = block_t::create( reserve, reserve, m_alloc );
+      newBlock->m_numBytesAllocated.store( numBytes, std::memory_order_relaxed );
+
+      block_t * head = m_large.load( std::memory_order_relaxed );
+      do
+      {
+	newBlock->m_next = head;
+      }
+      while( !m_large.compare_exchange_weak( head, newBlock,
+					     std::memory_order_release, std::memory_order_relaxed ) );
+
+      return alignedStart( newBlock, 0, alignment );
+    }
+
+    // statistics are gathered from the blocks.  the result is approximate
+    // while other threads are allocating.
+    std::size_t sum( std::atomic<std::size_t> block_t::* counter )
+    {
+      std::size_t total = 0;
+      for( block_t * block = m_current.load( std::memory_order_acquire ); block; block = block->m_next )
+	total += ( block->*counter ).load( std::memory_order_relaxed );
+
+      for( block_t * block = m_large.load( std::memory_order_acquire ); block; block = block->m_next )
+	total += ( block->*counter ).load( std::memory_order_relaxed );
+
+      return total;
+    }
+  };
+
+  // Arena allocator which may be copied, rebound and allocated from by any
+  // number of threads concurrently.
+  template< typename T, typename Allocator = _newAllocatorImpl >
+  using ConcurrentAlloc = Alloc< T, Allocator, _concurrentmemblockimpl<Allocator> >;
+
+}
+
+#endif
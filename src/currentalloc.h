@@ -0,0 +1,147 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  currentalloc.h
+ **
+ **  Stateless allocator allocating from the current arena of the calling
+ **  thread.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _CURRENT_ALLOC_H
+#define _CURRENT_ALLOC_H
+
+#include "arenaalloc.h"
+#include <new>
+#include <type_traits>
+
+namespace ArenaAlloc
+{
+
+  // the current arena of each thread, one per arena type
+  template< typename AllocatorImpl, typename MemblockImpl >
+  struct _currentArena
+  {
+    static thread_local Alloc< char, AllocatorImpl, MemblockImpl > * s_current;
+  };
+
+  template< typename AllocatorImpl, typename MemblockImpl >
+  thread_local Alloc< char, AllocatorImpl, MemblockImpl > * _currentArena< AllocatorImpl, MemblockImpl >::s_current = 0;
+
+  // Installs an arena as the current arena of the calling thread for the
+  // lifetime of the scope.  Scopes nest, the previous current arena is
+  // restored when a scope ends.
+  // i.e.
+  //   ArenaAlloc::Alloc<char> arena( 65536 );
+  //   {
+  //     ArenaAlloc::ArenaScope<> scope( arena );
+  //     std::map< int, int, std::less<int>, ArenaAlloc::CurrentAlloc< std::pair<const int, int> > > m;
+  //     ...
+  //   }
+  template< typename AllocatorImpl = _newAllocatorImpl, typename MemblockImpl = _memblockimpl<AllocatorImpl> >
+  class ArenaScope
+  {
+    typedef Alloc< char, AllocatorImpl, MemblockImpl > alloc_type;
+
+    alloc_type m_alloc; // holds a reference to the arena while in scope
+    alloc_type * m_previous;
+
+    ArenaScope( const ArenaScope& );
+    ArenaScope& operator = ( const ArenaScope& );
+
+  public:
+    template< typename T >
+    explicit ArenaScope( const Alloc< T, AllocatorImpl, MemblockImpl >& alloc ):
+      m_alloc( alloc ),
+      m_previous( _currentArena< AllocatorImpl, MemblockImpl >::s_current )
+    {
+      _currentArena< AllocatorImpl, MemblockImpl >::s_current = &m_alloc;
+    }
+
+    ~ArenaScope()
+    {
+      _currentArena< AllocatorImpl, MemblockImpl >::s_current = m_previous;
+    }
+  };
+
+  // An empty allocator holding no arena pointer and no reference count.
+  // Containers using it shrink by the allocator they no longer store and
+  // copies and rebinds cost nothing.  Every instance is equal.
+  //
+  // Memory comes from the current arena of the calling thread so a
+  // container must only grow while the arena it started with is current.
+  // Allocating with no current arena throws std::bad_alloc.  Deallocation
+  // with no current arena does nothing, the memory goes with its arena.
+  // Deallocation under another current arena is unsafe in general.  A
+  // basic arena (_memblockimpl) leaves memory of another arena alone, but
+  // a recycling or slab arena would put it on its own free lists.  A container should be destroyed within
+  // the scope of the arena it allocated from.
+  template< typename T, typename AllocatorImpl = _newAllocatorImpl,
+	    typename MemblockImpl = _memblockimpl<AllocatorImpl> >
+  class CurrentAlloc
+  {
+  public:
+    // type definitions
+    typedef T        value_type;
+    typedef T*       pointer;
+    typedef const T* const_pointer;
+    typedef T&       reference;
+    typedef const T& const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    typedef std::true_type is_always_equal;
+
+    // rebind allocator to type U
+    template <class U>
+    struct rebind {
+      typedef CurrentAlloc<U,AllocatorImpl,MemblockImpl> other;
+    };
+
+    CurrentAlloc() throw() {}
+
+    template <class U>
+    CurrentAlloc( const CurrentAlloc<U,AllocatorImpl,MemblockImpl>& ) throw() {}
+
+    // return maximum number of elements that can be allocated
+    size_type max_size () const throw()
+    {
+      return std::numeric_limits<std::size_t>::max() / sizeof(T);
+    }
+
+    // allocate but don't initialize num elements of type T
+    pointer allocate( size_type num, const void* = 0 )
+    {
+      Alloc< char, AllocatorImpl, MemblockImpl > * arena = _currentArena< AllocatorImpl, MemblockImpl >::s_current;
+      if( !arena )
+	throw std::bad_alloc();
+
+      return reinterpret_cast<pointer>( arena->allocateBytes( num*sizeof(T), alignof(T) ) );
+    }
+
+    // deallocate storage p of deleted elements
+    void deallocate( pointer p, size_type num )
+    {
+      Alloc< char, AllocatorImpl, MemblockImpl > * arena = _currentArena< AllocatorImpl, MemblockImpl >::s_current;
+      if( arena )
+	arena->deallocateBytes( p, num*sizeof(T), alignof(T) );
+    }
+
+    template< typename P, typename... Args>
+    void construct( P* obj, Args&&... args )
+    {
+      ::new((void*) obj ) P( std::forward<Args>( args )... );
+    }
+
+    template< typename P >
+    void destroy( P* obj ) { obj->~P(); }
+
+    template< typename Other >
+    bool operator == ( const CurrentAlloc< Other, AllocatorImpl, MemblockImpl >& ) const { return true; }
+
+    template< typename Other >
+    bool operator != ( const CurrentAlloc< Other, AllocatorImpl, MemblockImpl >& ) const { return false; }
+  };
+
+}
+
+#endif
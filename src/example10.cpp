@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * example10.cpp
+ * Several processes sharing one arena.  The parent creates a shared
+ * memory segment and a table of result slots in it, then forks workers.
+ * Each worker builds a map in the shared arena concurrently with the
+ * others and publishes it in its slot.  The parent reads every worker's
+ * map directly, nothing is serialised or copied between the processes.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <iostream>
+#include <map>
+#include <functional>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "arenaalloc.h"
+#include "shmalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example10 example10.cpp
+// run as: ./example10 [numWorkers]
+
+typedef std::pair<const long, long> valuetype;
+typedef std::map< long, long, std::less<long>, ArenaAlloc::ShmAlloc<valuetype> > maptype;
+
+const long numEntries = 200000;
+
+// the workers fill their maps at the same time, every node allocation is
+// an atomic bump of the cursor in the segment's header.
+static void work( maptype ** slot, int worker, int numWorkers, ArenaAlloc::ShmSegment& segment )
+{
+  ArenaAlloc::ShmAlloc<maptype> alloc( 0, segment );
+  maptype * values = new ( alloc.allocate( 1 ) ) maptype( std::less<long>(), alloc );
+  for( long i = 0; i < numEntries; i++ )
+    values->insert( valuetype( i * numWorkers + worker, i ) );
+
+  *slot = values;
+}
+
+int main( int argc, char ** argv )
+{
+  int numWorkers = argc > 1 ? atoi( argv[1] ) : 4;
+
+  // anonymous segments are shared with children forked after their
+  // creation, at the same address.
+  ArenaAlloc::ShmSegment segment( 1024UL*1024*1024 );
+  ArenaAlloc::ShmAlloc<maptype*> alloc( 0, segment );
+
+  maptype ** slots = alloc.allocate( numWorkers );
+  for( int i = 0; i < numWorkers; i++ )
+    slots[i] = 0;
+  segment.setRoot( slots );
+
+  for( int i = 0; i < numWorkers; i++ )
+  {
+    pid_t pid = fork();
+    if( pid < 0 )
+      return 1;
+
+    if( pid == 0 )
+    {
+      work( segment.root<maptype*>() + i, i, numWorkers, segment );
+      _exit( 0 );
+    }
+  }
+
+  for( int i = 0; i < numWorkers; i++ )
+  {
+    int status = 0;
+    if( wait( &status ) < 0 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+    {
+      std::cerr << "worker failed" << std::endl;
+      return 1;
+    }
+  }
+
+  for( int i = 0; i < numWorkers; i++ )
+  {
+    const maptype& values = *slots[i];
+    long sum = 0;
+    for( maptype::const_iterator itr = values.begin(); itr != values.end(); ++itr )
+      sum += itr->first - itr->second * numWorkers;
+
+    std::cout << "worker " << i << " built " << values.size() << " entries, checksum "
+	      << sum / numEntries << std::endl;
+  }
+
+  std::cout << "arena: " << alloc.getNumAllocations() << " allocations, "
+	    << alloc.getNumBytesAllocated() << " bytes from " << numWorkers + 1 << " processes" << std::endl;
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * example11.cpp
+ * Warm start from a snapshot.  A map of a few million entries is built
+ * in a SnapshotRegion and saved to a file by one process.  A second
+ * process restores the file and looks entries up straight away, the
+ * restore costs a mapping rather than a rebuild.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <functional>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "arenaalloc.h"
+#include "snapshot.h"
+
+// compile as: g++ -O2 -std=c++11 -o example11 example11.cpp
+// run as: ./example11 [numEntries] [snapshotFile]
+
+typedef std::chrono::steady_clock clock_type;
+typedef std::pair<const long, double> valuetype;
+typedef ArenaAlloc::Alloc<valuetype, ArenaAlloc::SnapshotAllocatorImpl> alloctype;
+typedef std::map< long, double, std::less<long>, alloctype > maptype;
+
+static double elapsedMs( clock_type::time_point start )
+{
+  return std::chrono::duration<double, std::milli>( clock_type::now() - start ).count();
+}
+
+static int build( long numEntries, const char * path )
+{
+  clock_type::time_point start = clock_type::now();
+  ArenaAlloc::SnapshotRegion region( 64UL*1024*1024*1024 );
+  alloctype alloc( 4*1024*1024, region.allocatorImpl() );
+
+  ArenaAlloc::Alloc<maptype, ArenaAlloc::SnapshotAllocatorImpl> mapAlloc( alloc );
+  maptype * values = new ( mapAlloc.allocate( 1 ) ) maptype( std::less<long>(), alloc );
+  for( long i = 0; i < numEntries; i++ )
+    values->insert( valuetype( i * 7, i * 0.5 ) );
+
+  region.setRoot( values );
+  std::cout << "built " << values->size() << " entries in " << elapsedMs( start ) << " ms" << std::endl;
+
+  start = clock_type::now();
+  region.save( path, ArenaAlloc::snapshotFingerprint<maptype>() );
+  std::cout << "saved " << region.used() / ( 1024*1024 ) << " MB in " << elapsedMs( start ) << " ms" << std::endl;
+  return 0;
+}
+
+static int restore( long numEntries, const char * path )
+{
+  clock_type::time_point start = clock_type::now();
+  ArenaAlloc::SnapshotRegion region( path, ArenaAlloc::snapshotFingerprint<maptype>() );
+  maptype * values = region.root<maptype>();
+  std::cout << "restored in " << elapsedMs( start ) << " ms" << std::endl;
+
+  start = clock_type::now();
+  double sum = 0;
+  for( long i = 0; i < numEntries; i += 1000 )
+    sum += values->find( i * 7 )->second;
+  std::cout << "first lookups took " << elapsedMs( start ) << " ms, sum " << sum << std::endl;
+
+  // the restored map keeps working, new nodes come from the region
+  values->insert( valuetype( -1, 0 ) );
+  std::cout << "now holds " << values->size() << " entries" << std::endl;
+
+  // a snapshot with another fingerprint is refused
+  try
+  {
+    ArenaAlloc::SnapshotRegion other( path, ArenaAlloc::snapshotFingerprint<maptype>( 1 ) );
+  }
+  catch( const std::runtime_error& e )
+  {
+    std::cout << "version 1 refused: " << e.what() << std::endl;
+  }
+
+  return 0;
+}
+
+int main( int argc, char ** argv )
+{
+  long numEntries = argc > 1 ? atol( argv[1] ) : 4000000;
+  const char * path = argc > 2 ? argv[2] : "/tmp/example11.snapshot";
+
+  // the snapshot is built in a separate process, as it would be by a
+  // previous run of a service.
+  pid_t pid = fork();
+  if( pid == 0 )
+    _exit( build( numEntries, path ) );
+
+  int status = 0;
+  if( pid < 0 || waitpid( pid, &status, 0 ) < 0 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+    return 1;
+
+  int result = restore( numEntries, path );
+  unlink( path );
+  return result;
+}
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * example12.cpp
+ * Tracing.  Built with ARENA_ALLOC_TRACE the arenas record binary events
+ * into per thread ring buffers at a cost of a few nanoseconds each.
+ * Two threads churn maps in an arena and a recycle arena and use a
+ * scratch arena reset per batch, then the trace is written for
+ * tracedecode.cpp to report on, i.e.
+ *   ./example12 /tmp/example12.trace && ./tracedecode /tmp/example12.trace
+ *
+ * MIT license
+ *****************************************************************************/
+#define ARENA_ALLOC_TRACE
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example12 example12.cpp -lpthread
+// run as: ./example12 [tracefile]
+
+template< typename AllocType >
+void churn( AllocType alloc, int numOperations )
+{
+  typedef typename AllocType::template rebind< std::pair<const int, int> >::other pairAlloc;
+  std::map< int, int, std::less<int>, pairAlloc > values( std::less<int>(), alloc );
+  for( int i = 0; i < numOperations; i++ )
+  {
+    values[i] = i;
+    if( i > 100 )
+      values.erase( i - 100 );
+  }
+}
+
+void work( int numOperations )
+{
+  churn( ArenaAlloc::Alloc<char>( 65536 ), numOperations );
+  churn( ArenaAlloc::RecycleAlloc<char>( 65536 ), numOperations );
+
+  ArenaAlloc::Alloc<char> scratch( 4096 );
+  for( int batch = 0; batch < 100; batch++ )
+  {
+    std::vector< int, ArenaAlloc::Alloc<int> > temp( scratch );
+    for( int i = 0; i < 1000; i++ )
+      temp.push_back( i );
+    scratch.reset();
+  }
+}
+
+int main( int argc, char ** argv )
+{
+  const char * path = argc > 1 ? argv[1] : "/tmp/example12.trace";
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::thread first( work, 20000 );
+  std::thread second( work, 20000 );
+  first.join();
+  second.join();
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "traced run took " << elapsed.count() << " ms" << std::endl;
+
+  if( !ArenaAlloc::ArenaTrace::write( path ) )
+  {
+    std::cerr << "unable to write " << path << std::endl;
+    return 1;
+  }
+
+  std::cout << "trace written to " << path << std::endl;
+  return 0;
+}
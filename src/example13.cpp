@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * example13.cpp
+ * Generation flips with migrate().  An index of map< string,
+ * vector<string> > lives in an arena while entries are added and
+ * replaced, which leaves the memory of every replaced string and vector
+ * behind in the arena.  Each generation the index is migrated into a
+ * fresh arena, strings and vectors included, and the old arena is
+ * released.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "arenaalloc.h"
+#include "migrate.h"
+
+// compile as: g++ -O2 -std=c++11 -o example13 example13.cpp
+
+typedef ArenaAlloc::Alloc<char> alloctype;
+typedef std::basic_string< char, std::char_traits<char>, ArenaAlloc::Alloc<char> > strtype;
+typedef std::vector< strtype, ArenaAlloc::Alloc<strtype> > valuestype;
+typedef std::map< strtype, valuestype, std::less<strtype>, ArenaAlloc::Alloc< std::pair<const strtype, valuestype> > > indextype;
+
+int main()
+{
+  alloctype * arena = new alloctype( 1024*1024 );
+  indextype index( std::less<strtype>(), *arena );
+
+  for( int generation = 0; generation < 5; generation++ )
+  {
+    // every key is rewritten each generation
+    for( int round = 0; round < 4; round++ )
+    {
+      for( int i = 0; i < 20000; i++ )
+      {
+	valuestype values( *arena );
+	for( int j = 0; j < 4; j++ )
+	  values.push_back( strtype( ( "value " + std::to_string( generation * 100 + round * 10 + j ) +
+				       " of a reasonably long entry" ).c_str(), *arena ) );
+
+	indextype::iterator itr = index.find( strtype( ( "key " + std::to_string( i ) ).c_str(), *arena ) );
+	if( itr == index.end() )
+	  index.insert( std::make_pair( strtype( ( "key " + std::to_string( i ) ).c_str(), *arena ), values ) );
+	else
+	  itr->second = values;
+      }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    alloctype * next = new alloctype( 1024*1024 );
+    ArenaAlloc::MigrateResult result = ArenaAlloc::migrate( index, *next );
+    delete arena; // the index no longer uses it, its memory is released
+    arena = next;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "generation " << generation << ": " << index.size() << " keys, arena of "
+	      << result.m_sourceBytes / 1024 << " KB migrated into " << result.m_targetBytes / 1024 << " KB, "
+	      << result.bytesReclaimed() / 1024 << " KB reclaimed in " << elapsed.count() << " ms" << std::endl;
+  }
+
+  std::cout << "key 42's last value is \"" << index.find( strtype( "key 42", *arena ) )->second.back() << "\"" << std::endl;
+  index.clear();
+  delete arena;
+  return 0;
+}
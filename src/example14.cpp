@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * example14.cpp
+ * Block growth policies.  A large arena is filled with fixed, geometric
+ * and adaptive growth, counting the blocks obtained and the time taken,
+ * then many small arenas are created the way a server creates one per
+ * connection, comparing the memory reserved by fixed 32KB blocks with
+ * geometric growth starting at 1KB.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "arenaalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example14 example14.cpp
+
+// counts what the arenas obtain.  requests of a block's worth are blocks,
+// the rest are the arenas' bookkeeping.
+struct countingAllocatorImpl
+{
+  static std::size_t s_numBlocks;
+  static std::size_t s_numBytes;
+
+  void* allocate( size_t numBytes )
+  {
+    if( numBytes >= 256 )
+      ++ s_numBlocks;
+    s_numBytes += numBytes;
+    return new char[ numBytes ];
+  }
+
+  void deallocate( void* ptr ) { delete[]( (char*)ptr ); }
+
+  static void resetCounts() { s_numBlocks = s_numBytes = 0; }
+};
+
+std::size_t countingAllocatorImpl::s_numBlocks = 0;
+std::size_t countingAllocatorImpl::s_numBytes = 0;
+
+typedef ArenaAlloc::_fixedGrowth fixed;
+typedef ArenaAlloc::_geometricGrowth< 64*1024*1024 > geometric;
+typedef ArenaAlloc::_adaptiveGrowth< 64*1024*1024, 10 > adaptive;
+
+template< typename GrowthPolicy >
+void fill( const char * name, std::size_t numBytes )
+{
+  typedef ArenaAlloc::GrowthAlloc< long, GrowthPolicy, countingAllocatorImpl > alloctype;
+  countingAllocatorImpl::resetCounts();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    alloctype alloc( 32*1024 );
+    std::size_t count = numBytes / 64;
+    for( std::size_t i = 0; i < count; i++ )
+      *alloc.allocate( 8 ) = i; // 64 bytes
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << name << ": " << numBytes / ( 1024*1024 ) << " MB in " << countingAllocatorImpl::s_numBlocks
+	    << " blocks, " << elapsed.count() << " ms" << std::endl;
+}
+
+template< typename GrowthPolicy >
+void manySmall( const char * name, std::size_t defaultSize, std::size_t numArenas )
+{
+  typedef ArenaAlloc::GrowthAlloc< char, GrowthPolicy, countingAllocatorImpl > alloctype;
+  countingAllocatorImpl::resetCounts();
+
+  std::vector< alloctype > arenas;
+  arenas.reserve( numArenas );
+  for( std::size_t i = 0; i < numArenas; i++ )
+  {
+    arenas.push_back( alloctype( defaultSize ) );
+    // most connections need a few hundred bytes, every hundredth 100KB
+    std::size_t numAllocations = i % 100 ? 8 : 1600;
+    for( std::size_t j = 0; j < numAllocations; j++ )
+      arenas.back().allocate( 64 );
+  }
+
+  std::cout << name << ": " << numArenas << " arenas reserved " << countingAllocatorImpl::s_numBytes / 1024
+	    << " KB in " << countingAllocatorImpl::s_numBlocks << " blocks" << std::endl;
+}
+
+int main()
+{
+  fill<fixed>( "fixed 32KB blocks", 1024UL*1024*1024 );
+  fill<geometric>( "geometric from 32KB", 1024UL*1024*1024 );
+  fill<adaptive>( "adaptive from 32KB", 1024UL*1024*1024 );
+
+  manySmall<fixed>( "fixed 32KB blocks", 32*1024, 10000 );
+  manySmall<geometric>( "geometric from 1KB", 1024, 10000 );
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+ * example15.cpp
+ * Large allocations.  A vector grown to 256MB in an arena leaves every
+ * buffer it outgrew in the arena's blocks until the arena goes, about
+ * as much again as the vector itself.  With a large threshold set the
+ * buffers get memory of their own which the vector's deallocations give
+ * straight back.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include "arenaalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example15 example15.cpp
+
+static long residentKB()
+{
+  long pages = 0, resident = 0;
+  FILE * statm = fopen( "/proc/self/statm", "r" );
+  if( statm )
+  {
+    if( fscanf( statm, "%ld %ld", &pages, &resident ) != 2 )
+      resident = 0;
+    fclose( statm );
+  }
+  return resident * ( sysconf( _SC_PAGESIZE ) / 1024 );
+}
+
+void grow( const char * name, std::size_t largeThreshold )
+{
+  long before = residentKB();
+  ArenaAlloc::Alloc<int> alloc( 1024*1024 );
+  alloc.setLargeThreshold( largeThreshold );
+
+  std::vector< int, ArenaAlloc::Alloc<int> > values( alloc );
+  for( int i = 0; i < 64*1024*1024; i++ )
+    values.push_back( i );
+
+  std::cout << name << ": vector of " << values.capacity() * sizeof( int ) / 1024 << " KB, RSS grew by "
+	    << residentKB() - before << " KB" << std::endl;
+}
+
+int main()
+{
+  grow( "no threshold", std::numeric_limits<std::size_t>::max() );
+  grow( "256KB threshold", 256*1024 );
+  return 0;
+}
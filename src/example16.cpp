@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * example16.cpp
+ * Reclaiming the top of the arena.  A buffer appended to is grown in
+ * place by ArenaVector where std::vector copies it and leaves each
+ * outgrown buffer in the arena, and temporaries freed as soon as they
+ * are made are taken back off the arena instead of accumulating.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "arenaalloc.h"
+#include "arenavector.h"
+
+// compile as: g++ -O2 -std=c++11 -o example16 example16.cpp
+
+// counts the bytes the arenas obtain
+struct countingAllocatorImpl
+{
+  static std::size_t s_numBytes;
+
+  void* allocate( size_t numBytes )
+  {
+    s_numBytes += numBytes;
+    return new char[ numBytes ];
+  }
+
+  void deallocate( void* ptr ) { delete[]( (char*)ptr ); }
+};
+
+std::size_t countingAllocatorImpl::s_numBytes = 0;
+
+typedef ArenaAlloc::Alloc< int, countingAllocatorImpl > alloctype;
+typedef std::basic_string< char, std::char_traits<char>, ArenaAlloc::Alloc< char, countingAllocatorImpl > > strtype;
+
+template< typename Vector >
+void append( const char * name, int count )
+{
+  countingAllocatorImpl::s_numBytes = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    alloctype alloc( 64*1024*1024 );
+    Vector values( alloc );
+    for( int i = 0; i < count; i++ )
+      values.push_back( i );
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << count << " ints appended in " << elapsed.count() << " ms with "
+	      << alloc.getNumAllocations() << " buffers allocated, arena reserved "
+	      << countingAllocatorImpl::s_numBytes / 1024 << " KB" << std::endl;
+  }
+}
+
+int main()
+{
+  append< std::vector< int, alloctype > >( "std::vector", 8*1024*1024 );
+  append< ArenaAlloc::ArenaVector< int, alloctype > >( "ArenaVector", 8*1024*1024 );
+
+  // each string is freed before the next is made so its memory is reused
+  countingAllocatorImpl::s_numBytes = 0;
+  alloctype alloc( 64*1024 );
+  std::size_t length = 0;
+  for( int i = 0; i < 1000000; i++ )
+  {
+    strtype temp( ( "a temporary string too long for the small string buffer " + std::to_string( i ) ).c_str(), alloc );
+    length += temp.size();
+  }
+  std::cout << "1000000 temporary strings of " << length / 1000000 << " characters, arena reserved "
+	    << countingAllocatorImpl::s_numBytes / 1024 << " KB" << std::endl;
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * example17.cpp
+ * Segregated arenas.  A large map of int to string is built in a basic
+ * arena, where every node is followed by its string, and in a
+ * segregated arena, where the nodes lie in runs of their own apart from
+ * the strings.  Traversals reading only the keys then touch a fraction
+ * of the memory.  The gain is for nodes allocated in about the order
+ * they are visited; inserted in random order they are visited in
+ * scattered order either way.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "arenaalloc.h"
+#include "segregatedalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example17 example17.cpp
+
+typedef ArenaAlloc::_segregatedimpl< ArenaAlloc::_newAllocatorImpl > segimpl;
+
+typedef std::basic_string< char, std::char_traits<char>, ArenaAlloc::Alloc<char> > strtype;
+typedef std::map< int, strtype, std::less<int>, ArenaAlloc::Alloc< std::pair<const int, strtype> > > maptype;
+
+typedef std::basic_string< char, std::char_traits<char>, ArenaAlloc::Alloc< char, ArenaAlloc::_newAllocatorImpl, segimpl > > segstrtype;
+typedef std::map< int, segstrtype, std::less<int>, ArenaAlloc::SegregatedAlloc< std::pair<const int, segstrtype> > > segmaptype;
+
+template< typename Map, typename String, typename AllocType >
+void run( const char * name, const AllocType& alloc, const std::vector<int>& keys )
+{
+  Map values( std::less<int>(), alloc );
+  for( std::size_t i = 0; i < keys.size(); i++ )
+    values.insert( std::make_pair( keys[i], String( 100, char( 'a' + keys[i] % 26 ), alloc ) ) );
+
+  // the best of several traversals summing the keys
+  double best = 0;
+  long long sum = 0;
+  for( int pass = 0; pass < 5; pass++ )
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for( typename Map::const_iterator itr = values.begin(); itr != values.end(); ++itr )
+      sum += itr->first;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    if( pass == 0 || elapsed.count() < best )
+      best = elapsed.count();
+  }
+
+  std::cout << "  " << name << ": traversal of " << values.size() << " entries took " << best
+	    << " ms (checksum " << sum << ")" << std::endl;
+}
+
+int main()
+{
+  const int numEntries = 2000000;
+  std::vector<int> keys( numEntries );
+  for( int i = 0; i < numEntries; i++ )
+    keys[i] = i;
+
+  std::cout << "keys inserted in order" << std::endl;
+  run< maptype, strtype >( "basic arena", ArenaAlloc::Alloc<char>( 1024*1024 ), keys );
+  run< segmaptype, segstrtype >( "segregated arena", ArenaAlloc::SegregatedAlloc<char>( 1024*1024 ), keys );
+
+  std::shuffle( keys.begin(), keys.end(), std::mt19937( 42 ) );
+  std::cout << "keys inserted in random order" << std::endl;
+  run< maptype, strtype >( "basic arena", ArenaAlloc::Alloc<char>( 1024*1024 ), keys );
+  run< segmaptype, segstrtype >( "segregated arena", ArenaAlloc::SegregatedAlloc<char>( 1024*1024 ), keys );
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * example18.cpp
+ * Checkpoints over recycling arenas.  A long lived cache of strings is
+ * kept in an arena which also serves the scratch work of each request
+ * under a RewindGuard.  Entries are evicted between requests, so chunks
+ * freed before a mark are reused after the rewind alongside those the
+ * rewind discarded.  The cache is checked against a std::map copy at
+ * the end.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+#include "slaballoc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example18 example18.cpp
+
+template< typename AllocType >
+bool run( const char * name, const AllocType& alloc )
+{
+  typedef typename AllocType::template rebind<char>::other charalloc;
+  typedef std::basic_string< char, std::char_traits<char>, charalloc > strtype;
+  typedef typename AllocType::template rebind< std::pair<const int, strtype> >::other mapalloc;
+  typedef std::map< int, strtype, std::less<int>, mapalloc > cachetype;
+
+  charalloc strings( alloc );
+  cachetype cache( std::less<int>(), alloc );
+  std::map< int, std::string > expected;
+
+  srand( 42 );
+  for( int request = 0; request < 2000; request++ )
+  {
+    // evict an entry every other request and cache a new one, some large
+    // enough for a region of their own
+    if( request % 2 && !cache.empty() )
+    {
+      typename cachetype::iterator itr = cache.lower_bound( rand() % 10000 );
+      if( itr == cache.end() )
+	itr = cache.begin();
+      expected.erase( itr->first );
+      cache.erase( itr );
+    }
+
+    int key = rand() % 10000;
+    std::size_t length = rand() % 8 ? rand() % 2000 : 20000 + rand() % 50000;
+    cache.erase( key );
+    cache.insert( std::make_pair( key, strtype( length, char( 'a' + key % 26 ), strings ) ) );
+    expected[ key ] = std::string( length, char( 'a' + key % 26 ) );
+
+    // the scratch work of the request, gone when the guard rewinds
+    ArenaAlloc::RewindGuard< charalloc > guard( strings );
+    std::vector< strtype, typename AllocType::template rebind<strtype>::other > scratch( alloc );
+    for( int i = 0; i < 50; i++ )
+      scratch.push_back( strtype( rand() % 3000, 'x', strings ) );
+    scratch.erase( scratch.begin(), scratch.begin() + 25 );
+  }
+
+  bool ok = cache.size() == expected.size();
+  for( typename cachetype::const_iterator itr = cache.begin(); ok && itr != cache.end(); ++itr )
+    ok = expected[ itr->first ] == itr->second.c_str();
+
+  std::cout << name << ": " << cache.size() << " entries cached, " << ( ok ? "intact" : "CORRUPTED" ) << std::endl;
+  return ok;
+}
+
+int main()
+{
+  bool ok = run( "RecycleAlloc", ArenaAlloc::RecycleAlloc<char>( 65536 ) );
+  ok = run( "SizedRecycleAlloc", ArenaAlloc::SizedRecycleAlloc<char>( 65536 ) ) && ok;
+  ok = run( "SlabAlloc", ArenaAlloc::SlabAlloc<char>( 65536 ) ) && ok;
+  return ok ? 0 : 1;
+}
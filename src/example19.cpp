@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * example19.cpp
+ * Arena telemetry.  Built with ARENA_ALLOC_STATS and ARENA_ALLOC_REGISTRY
+ * defined, a few labelled arenas of each kind fill maps and strings, then
+ * the detailed statistics of each are printed with getStats() and the
+ * registry's totals, per label, with dumpText() and dumpJson().
+ *
+ * MIT license
+ *****************************************************************************/
+#define ARENA_ALLOC_STATS
+#define ARENA_ALLOC_REGISTRY
+
+#include <iostream>
+#include <map>
+#include <string>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+#include "slaballoc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example19 example19.cpp
+
+template< typename AllocType >
+void fill( AllocType alloc, const char * label, int numEntries )
+{
+  typedef typename AllocType::template rebind<char>::other charalloc;
+  typedef std::basic_string< char, std::char_traits<char>, charalloc > strtype;
+  typedef typename AllocType::template rebind< std::pair<const int, strtype> >::other mapalloc;
+
+  alloc.setLabel( label );
+  std::map< int, strtype, std::less<int>, mapalloc > values( std::less<int>(), alloc );
+  for( int i = 0; i < numEntries; i++ )
+    values[ i % ( numEntries / 2 ) ] = strtype( 20 + i % 200, 'x', alloc );
+}
+
+template< typename AllocType >
+void printStats( const char * name, const AllocType& alloc )
+{
+  ArenaAlloc::ArenaStats stats = alloc.getStats();
+  std::cout << name << ": blocks=" << stats.m_numBlocks << " reserved=" << stats.m_reservedBytes
+	    << " used=" << stats.m_usedBytes << " peak=" << stats.m_peakUsedBytes
+	    << " tailWaste=" << stats.m_tailWaste << " requested=" << stats.m_requestedBytes
+	    << " recycled=" << stats.m_recycledHits << " fresh=" << stats.m_freshHits << std::endl;
+
+  std::cout << "  request sizes:";
+  for( std::size_t i = 0; i < ArenaAlloc::ArenaStats::HistogramBuckets; i++ )
+    if( stats.m_sizeHistogram[i] )
+      std::cout << " " << ( std::size_t( 1 ) << i ) << "+:" << stats.m_sizeHistogram[i];
+  std::cout << std::endl;
+}
+
+int main()
+{
+  ArenaAlloc::Alloc<char> basic( 65536 );
+  ArenaAlloc::RecycleAlloc<char> recycle( 65536 );
+  ArenaAlloc::SlabAlloc<char> slab( 65536 );
+
+  fill( basic, "parser", 20000 );
+  fill( recycle, "cache", 20000 );
+  fill( slab, "cache", 20000 );
+
+  printStats( "Alloc", basic );
+  printStats( "RecycleAlloc", recycle );
+  printStats( "SlabAlloc", slab );
+
+  std::cout << std::endl;
+  ArenaAlloc::ArenaRegistry::dumpText( std::cout );
+  ArenaAlloc::ArenaRegistry::dumpJson( std::cout );
+  return 0;
+}
@@ -1,157 +1,555 @@
 /*******************************************************************************
  * example2.cpp
- * Measure time to write to containers in one of 2 modes:
- * 1.  using the standard STL allocator
- * 2.  using ArenaAlloc
+ * Benchmark suite.  Every allocator is run on every workload at each
+ * thread count, every thread working on containers of its own backed by
+ * its own allocator instance.  Allocators:
+ * 1.  the standard STL allocator
+ * 2.  ArenaAlloc::Alloc
+ * 3.  ArenaAlloc::RecycleAlloc
+ * 4.  ArenaAlloc::SlabAlloc
+ * 5.  ArenaAlloc::CurrentAlloc with an Alloc arena in scope
+ * 6.  std::pmr::monotonic_buffer_resource (c++17)
+ * 7.  ArenaAlloc::memory_resource and recycle_memory_resource through
+ *     std::pmr::polymorphic_allocator (c++17)
  *
- * This software is distributed under the terms of the MIT license.  
+ * Workloads:
+ * map       the original example2 loop, map<int,string> insert i and erase i-5
+ * umap      unordered_map<int,int> random insert or erase
+ * vector    vectors grown element by element to 1..1024 elements
+ * list      list<int> used as a 10000 element fifo
+ * string    map of mixed length strings with random entries replaced
+ * teardown  destruction of a map<int,int> of numOps entries and its allocator
+ *
+ * Each case runs in a child process so peak RSS belongs to that case
+ * alone.  Reported per case: ns/op, peak RSS, peak bytes the allocator
+ * obtained from the system (reserved) and peak bytes the containers held
+ * live (used, measured once per workload with a counting std::allocator).
+ *
+ * This software is distributed under the terms of the MIT license.
  * Don't panic!!!! Share and enjoy.
  *****************************************************************************/
 #include <thread>
-#include <condition_variable>
-#include <mutex>
 #include <chrono>
 #include <iostream>
+#include <sstream>
 #include <vector>
-#include <algorithm>
 #include <map>
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include "arenaalloc.h"
 #include "recyclealloc.h"
+#include "slaballoc.h"
+#include "currentalloc.h"
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#include "memoryresource.h"
+#endif
+
+// compile as: g++ -O2 -std=c++17 -o example2 example2.cpp -lpthread
+// run as: ./example2 [--ops N] [--threads 1,2,4] [--json]
+// the thread counts default to 1, 2, 4, ... hardware_concurrency()
+
+// As with any allocator benchmark try it with tcmalloc or jemalloc preloaded also.
+
+typedef std::chrono::steady_clock clock_type;
+
+// peak bytes currently held by the counting allocators of the running case
+static std::atomic<std::size_t> s_current( 0 );
+static std::atomic<std::size_t> s_peak( 0 );
+
+static void countAllocate( std::size_t numBytes )
+{
+  std::size_t current = s_current.fetch_add( numBytes ) + numBytes;
+  std::size_t peak = s_peak.load();
+  while( current > peak && !s_peak.compare_exchange_weak( peak, current ) )
+    ;
+}
+
+static void countDeallocate( std::size_t numBytes )
+{
+  s_current.fetch_sub( numBytes );
+}
+
+// AllocatorImpl for the arenas counting the blocks they reserve
+struct countingAllocatorImpl
+{
+  void* allocate( size_t numBytes )
+  {
+    countAllocate( numBytes );
+    std::size_t * block = reinterpret_cast<std::size_t*>( new char[ numBytes + 16 ] );
+    *block = numBytes;
+    return reinterpret_cast<char*>( block ) + 16;
+  }
+
+  void deallocate( void* ptr )
+  {
+    char * block = reinterpret_cast<char*>( ptr ) - 16;
+    countDeallocate( *reinterpret_cast<std::size_t*>( block ) );
+    delete[] block;
+  }
+};
+
+// std::allocator counting live container bytes
+template< typename T >
+struct countingStdAlloc : public std::allocator<T>
+{
+  typedef T value_type;
+  template< typename U > struct rebind { typedef countingStdAlloc<U> other; };
+
+  countingStdAlloc() {}
+  template< typename U > countingStdAlloc( const countingStdAlloc<U>& ) {}
+
+  T* allocate( std::size_t n )
+  {
+    countAllocate( n * sizeof( T ) );
+    return std::allocator<T>::allocate( n );
+  }
+
+  void deallocate( T* p, std::size_t n )
+  {
+    countDeallocate( n * sizeof( T ) );
+    std::allocator<T>::deallocate( p, n );
+  }
+};
+
+template< typename T, typename U >
+bool operator==( const countingStdAlloc<T>&, const countingStdAlloc<U>& ) { return true; }
+
+template< typename T, typename U >
+bool operator!=( const countingStdAlloc<T>&, const countingStdAlloc<U>& ) { return false; }
 
-// As promised in example1.cpp, this example requires c++11
-
-// compile as: g++ -O2 -DARENA_ALLOCATOR_TEST -std=c++11 -o example2-arena example2.cpp -lpthread
-// to test the arena allocator logic
-
-// compile as: g++ -O2 -std=c++11 -o example2-stdalloc example2.cpp -lpthread
-// to test the standard allocator.
-
-// If tcmalloc is available try this also:
-// g++ -O2 -std=c++11 -fno-builtin-malloc -o example2-stdtcmalloc example2.cpp -ltcmalloc -lpthread
-// g++ -O2 -DARENA_ALLOCATOR_TEST -std=c++11 -fno-builtin-malloc -o example2-arenatcmalloc example2.cpp -ltcmalloc -lpthread
-
-// In my testing of this not perfectly scientific example, the standard allocator + tcmalloc was faster by
-// a little bit over the arena allocator with the standard malloc.  Both of those were significantly 
-// faster than the standard allocator with the standard malloc.  I kept getting a core dump when 
-// running the arena allocator with tcmalloc so I cannot present results on that.  Give it a try though.
-// It's possible there may be a problem in how my code is structured for tcmalloc to work with the arena allocator.
-
-typedef std::chrono::high_resolution_clock::time_point hres_t;
-typedef std::chrono::duration<size_t, std::ratio<1,1000000> > duration_t; // duration in micro-seconds
-
-struct task
-{    
-  std::mutex& m_mutexRef;
-  std::condition_variable& m_condVarRef;
-  bool& m_run;
-
-  task( std::mutex& m, std::condition_variable& condVar, bool& runVar ):
-    m_mutexRef( m ),
-    m_run( runVar ),
-    m_condVarRef( condVar )
-  {     
-  }
-   
-  void  operator()()
-  {     
-    
-    // barrier synchronize the threads as much as possible to start them as close as possible
-    // to the same time.
+// An allocator family provides a context, one per thread and case, whose
+// get() returns the char allocator the containers are rebound from.
+template< typename CharAlloc >
+struct stdFamily
+{
+  CharAlloc get() { return CharAlloc(); }
+};
+
+template< typename CharAlloc >
+struct arenaFamily
+{
+  CharAlloc m_alloc;
+  arenaFamily(): m_alloc( 65536 ) {}
+  CharAlloc get() { return m_alloc; }
+};
+
+// installs its arena as the current arena of the thread running the case
+template< typename MemblockImpl >
+struct currentArenaFamily
+{
+  ArenaAlloc::Alloc< char, countingAllocatorImpl, MemblockImpl > m_alloc;
+  ArenaAlloc::ArenaScope< countingAllocatorImpl, MemblockImpl > m_scope;
+  currentArenaFamily(): m_alloc( 65536 ), m_scope( m_alloc ) {}
+  ArenaAlloc::CurrentAlloc< char, countingAllocatorImpl, MemblockImpl > get() 
+  { 
+    return ArenaAlloc::CurrentAlloc< char, countingAllocatorImpl, MemblockImpl >(); 
+  }
+};
+
+#if __cplusplus >= 201703L
+struct countingResource : public std::pmr::memory_resource
+{
+  void * do_allocate( std::size_t numBytes, std::size_t alignment )
+  {
+    countAllocate( numBytes );
+    return std::pmr::new_delete_resource()->allocate( numBytes, alignment );
+  }
+
+  void do_deallocate( void * ptr, std::size_t numBytes, std::size_t alignment )
+  {
+    countDeallocate( numBytes );
+    std::pmr::new_delete_resource()->deallocate( ptr, numBytes, alignment );
+  }
+
+  bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept { return this == &other; }
+};
+
+struct monotonicFamily
+{
+  countingResource m_upstream;
+  std::pmr::monotonic_buffer_resource m_resource;
+  monotonicFamily(): m_resource( 65536, &m_upstream ) {}
+  std::pmr::polymorphic_allocator<char> get() { return std::pmr::polymorphic_allocator<char>( &m_resource ); }
+};
+
+template< typename Resource >
+struct arenaResourceFamily
+{
+  Resource m_resource;
+  arenaResourceFamily(): m_resource( 65536 ) {}
+  std::pmr::polymorphic_allocator<char> get() { return std::pmr::polymorphic_allocator<char>( &m_resource ); }
+};
+
+typedef arenaResourceFamily< ArenaAlloc::basic_memory_resource<countingAllocatorImpl> > arenaResourceAllocFamily;
+typedef arenaResourceFamily< ArenaAlloc::basic_memory_resource< countingAllocatorImpl,
+								ArenaAlloc::_recycleallocimpl<countingAllocatorImpl> > >
+recycleResourceAllocFamily;
+#endif
+
+template< typename CharAlloc, typename T >
+struct rebound
+{
+  typedef typename std::allocator_traits<CharAlloc>::template rebind_alloc<T> type;
+};
+
+// Workloads.  Each performs numOperations operations with a fresh
+// context and returns the nanoseconds to be counted.
+
+template< typename Family >
+double mapWork( int numOperations )
+{
+  clock_type::time_point start = clock_type::now();
+  {
+    Family family;
+    typedef decltype( family.get() ) charalloc;
+    typedef std::basic_string< char, std::char_traits<char>, charalloc > strtype;
+    typedef typename rebound< charalloc, std::pair< const int, strtype > >::type mapalloc;
+
+    mapalloc mapAllocator( family.get() );
+    std::map< int, strtype, std::less<int>, mapalloc > intToStrMap( std::less<int>(), mapAllocator );
+    strtype answerToEverything( "42", family.get() );
+    for( int i = 0; i < numOperations; i++ )
     {
-      std::unique_lock<std::mutex> lk( m_mutexRef );      
-      std::cout << "Thread=" << std::this_thread::get_id() << " is waiting..." << std::endl;
-      m_condVarRef.wait( lk, [this] { return m_run == true; }  ); // wait until the lambda condition is true
+      intToStrMap.insert( std::pair< const int, strtype >( i, answerToEverything ) ); // The answer to everything
+
+      if( i > 10 && ( i % 5 == 0 ) )
+	intToStrMap.erase( i - 5 );
     }
+  }
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
 
-    hres_t start = std::chrono::high_resolution_clock::now();
-    
-    // do map insert / delete
-    std::size_t numBytesAllocated = doWork();
-    
-    hres_t end = std::chrono::high_resolution_clock::now();    
-    duration_t timespan =  std::chrono::duration_cast< duration_t >( end - start );
-    
+template< typename Family >
+double umapWork( int numOperations )
+{
+  clock_type::time_point start = clock_type::now();
+  {
+    Family family;
+    typedef decltype( family.get() ) charalloc;
+    typedef typename rebound< charalloc, std::pair< const int, int > >::type mapalloc;
+
+    mapalloc mapAllocator( family.get() );
+    std::unordered_map< int, int, std::hash<int>, std::equal_to<int>, mapalloc >
+      intMap( 16, std::hash<int>(), std::equal_to<int>(), mapAllocator );
+    unsigned int seed = 42;
+    for( int i = 0; i < numOperations; i++ )
     {
-      // report timing results w/ lock held so that the output isn't all munged
-      std::lock_guard<std::mutex> lg( m_mutexRef );
-      std::cout << "threadid: " << std::this_thread::get_id() << " clicks: " << timespan.count();    
-#if defined( ARENA_ALLOCATOR_TEST  ) || ( RECYCLE_ALLOCATOR_TEST )
-      std::cout << " bytes allocated: " << numBytesAllocated << std::endl;
-#else
-      std::cout << std::endl;
-#endif
+      int key = rand_r( &seed ) % 100000;
+      if( !intMap.erase( key ) )
+	intMap.insert( std::make_pair( key, i ) );
     }
-  }    
-  
-  std::size_t doWork()
-  {
-    
-    // insert a million values into a map<int,strtype> using the specified map type
-#if defined (ARENA_ALLOCATOR_TEST)
-    typedef std::basic_string<char, std::char_traits<char>, ArenaAlloc::Alloc<char> > strtype;
-    ArenaAlloc::Alloc< char > charAllocator( 65536 );
-    strtype answerToEverything( "42", charAllocator );
-    
-    ArenaAlloc::Alloc< std::pair< const int, strtype > > alloc( 65536 );
-    std::map< int, strtype , std::less<int>, ArenaAlloc::Alloc<std::pair<const int,strtype> > > intToStrMap( std::less<int>(), alloc );    
-#elif defined(RECYCLE_ALLOCATOR_TEST)
-    typedef std::basic_string<char, std::char_traits<char>, ArenaAlloc::RecycleAlloc<char> > strtype;
-    ArenaAlloc::RecycleAlloc< char > charAllocator( 65536 );
-    strtype answerToEverything( "42", charAllocator );
-    
-    ArenaAlloc::RecycleAlloc< std::pair< const int, strtype > > alloc( 65536 );    
-    std::map< int, strtype , std::less<int>, ArenaAlloc::RecycleAlloc<std::pair<const int,strtype> > > 
-      intToStrMap( std::less<int>(), alloc );      
-#else 
-    typedef std::string strtype;
-    std::map<int, strtype> intToStrMap;
-    std::string answerToEverything( "42" );
-    std::allocator<char> charAllocator();
-#endif
-    
-    for( int i = 0; i < 10000000; i++ )
-    {      
-      intToStrMap.insert( std::pair< const int, strtype >( i, answerToEverything ) ); // The answer to everything
-      
-      if( i > 10 && ( i % 5 == 0 ) )
-	intToStrMap.erase( i - 5 ); // to provide some re-use for for testing the recycle allocator
+  }
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+template< typename Family >
+double vectorWork( int numOperations )
+{
+  clock_type::time_point start = clock_type::now();
+  {
+    Family family;
+    typedef typename rebound< decltype( family.get() ), int >::type intalloc;
+
+    intalloc intAllocator( family.get() );
+    std::size_t length = 1;
+    for( int i = 0; i < numOperations; )
+    {
+      std::vector< int, intalloc > ints( intAllocator );
+      for( std::size_t j = 0; j < length && i < numOperations; j++, i++ )
+	ints.push_back( i );
+
+      length = length % 1024 + 1;
+    }
+  }
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+template< typename Family >
+double listWork( int numOperations )
+{
+  clock_type::time_point start = clock_type::now();
+  {
+    Family family;
+    typedef typename rebound< decltype( family.get() ), int >::type intalloc;
+
+    intalloc intAllocator( family.get() );
+    std::list< int, intalloc > fifo( intAllocator );
+    for( int i = 0; i < numOperations; i++ )
+    {
+      fifo.push_back( i );
+      if( fifo.size() > 10000 )
+	fifo.pop_front();
+    }
+  }
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+template< typename Family >
+double stringWork( int numOperations )
+{
+  clock_type::time_point start = clock_type::now();
+  {
+    Family family;
+    typedef decltype( family.get() ) charalloc;
+    typedef std::basic_string< char, std::char_traits<char>, charalloc > strtype;
+    typedef typename rebound< charalloc, std::pair< const int, strtype > >::type mapalloc;
+
+    mapalloc mapAllocator( family.get() );
+    std::map< int, strtype, std::less<int>, mapalloc > strings( std::less<int>(), mapAllocator );
+    unsigned int seed = 42;
+    for( int i = 0; i < numOperations; i++ )
+    {
+      int key = rand_r( &seed ) % 10000;
+      std::size_t length = 8 + rand_r( &seed ) % ( rand_r( &seed ) % 8 ? 128 : 2048 ); // mostly short, some long
+      strings.erase( key );
+      strings.insert( std::make_pair( key, strtype( length, 'x', family.get() ) ) );
     }
-    
-    // Note: time to clear allocator is included in the runtime.
-#if defined( ARENA_ALLOCATOR_TEST ) || ( RECYCLE_ALLOCATOR_TEST )
-    return charAllocator.getNumBytesAllocated() + alloc.getNumBytesAllocated();
-#else
-    return 0;
-#endif
   }
-  
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+template< typename Family >
+double teardownWork( int numOperations )
+{
+  clock_type::time_point start;
+  {
+    Family family;
+    typedef typename rebound< decltype( family.get() ), std::pair< const int, int > >::type mapalloc;
+
+    mapalloc mapAllocator( family.get() );
+    std::map< int, int, std::less<int>, mapalloc > intMap( std::less<int>(), mapAllocator );
+    for( int i = 0; i < numOperations; i++ )
+      intMap.insert( std::make_pair( i, i ) );
+
+    start = clock_type::now();
+  }
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+struct result
+{
+  double m_nsPerOp;
+  long m_peakRssKB;
+  std::size_t m_reservedBytes;
 };
 
-int main()
+// runs the workload on numThreads threads started together and returns
+// the wall clock time of the slowest thread per operation
+template< typename Family >
+result runCase( double ( *work )( int ), std::size_t numThreads, int numOperations )
 {
-  
-  size_t concurrency = std::thread::hardware_concurrency();
-  std::cout << "Running with " << concurrency << " threads" << std::endl;
-  
+  std::atomic<std::size_t> ready( 0 );
+  std::atomic<bool> go( false );
+  std::vector<double> elapsed( numThreads );
   std::vector< std::thread > threads;
 
-  std::mutex m;
-  std::condition_variable cv;
-  bool runBool = false;
-  
-  for( size_t i = 0; i < concurrency; i++ )
+  for( std::size_t i = 0; i < numThreads; i++ )
+  {
+    threads.push_back( std::thread( [&, i]() {
+	  ++ready;
+	  while( !go.load() )
+	    std::this_thread::yield();
+	  elapsed[ i ] = work( numOperations );
+	} ) );
+  }
+
+  while( ready.load() != numThreads )
+    std::this_thread::yield();
+
+  go = true;
+  double slowest = 0;
+  for( std::size_t i = 0; i < numThreads; i++ )
+  {
+    threads[i].join();
+    if( elapsed[i] > slowest )
+      slowest = elapsed[i];
+  }
+
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+
+  result r;
+  r.m_nsPerOp = slowest / numOperations;
+  r.m_peakRssKB = usage.ru_maxrss;
+  r.m_reservedBytes = s_peak.load();
+  return r;
+}
+
+// runs the case in a child process.  returns false if the child failed.
+template< typename Family >
+bool forkCase( double ( *work )( int ), std::size_t numThreads, int numOperations, result& r )
+{
+  int fds[2];
+  if( pipe( fds ) != 0 )
+    return false;
+
+  pid_t pid = fork();
+  if( pid == 0 )
+  {
+    close( fds[0] );
+    result childResult = runCase<Family>( work, numThreads, numOperations );
+    ssize_t written = write( fds[1], &childResult, sizeof( childResult ) );
+    _exit( written == sizeof( childResult ) ? 0 : 1 );
+  }
+
+  close( fds[1] );
+  ssize_t numRead = pid > 0 ? read( fds[0], &r, sizeof( r ) ) : -1;
+  close( fds[0] );
+
+  int status = 0;
+  if( pid > 0 )
+    waitpid( pid, &status, 0 );
+
+  return numRead == sizeof( r ) && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+}
+
+struct reporter
+{
+  bool m_json;
+  bool m_first;
+
+  reporter( bool json ): m_json( json ), m_first( true )
+  {
+    if( m_json )
+      std::cout << "[" << std::endl;
+    else
+      std::cout << "workload,allocator,threads,ns/op,peak rss KB,reserved bytes,used bytes" << std::endl;
+  }
+
+  ~reporter()
+  {
+    if( m_json )
+      std::cout << std::endl << "]" << std::endl;
+  }
+
+  void report( const char * workload, const char * allocator, std::size_t numThreads,
+	       const result& r, std::size_t usedBytes )
   {
-    task t( m, cv, runBool );
-    threads.push_back( std::thread( t ) );
+    if( m_json )
+    {
+      std::cout << ( m_first ? "" : ",\n" )
+		<< "  {\"workload\": \"" << workload << "\", \"allocator\": \"" << allocator
+		<< "\", \"threads\": " << numThreads << ", \"ns_per_op\": " << r.m_nsPerOp
+		<< ", \"peak_rss_kb\": " << r.m_peakRssKB << ", \"reserved_bytes\": " << r.m_reservedBytes
+		<< ", \"used_bytes\": " << usedBytes << "}";
+    }
+    else
+    {
+      std::cout << workload << "," << allocator << "," << numThreads << "," << r.m_nsPerOp << ","
+		<< r.m_peakRssKB << "," << r.m_reservedBytes << "," << usedBytes << std::endl;
+    }
+    m_first = false;
+  }
+};
+
+typedef stdFamily< std::allocator<char> > stdAllocFamily;
+typedef stdFamily< countingStdAlloc<char> > countingFamily;
+typedef arenaFamily< ArenaAlloc::Alloc< char, countingAllocatorImpl > > arenaAllocFamily;
+typedef arenaFamily< ArenaAlloc::Alloc< char, countingAllocatorImpl,
+					ArenaAlloc::_recycleallocimpl<countingAllocatorImpl> > > recycleAllocFamily;
+typedef arenaFamily< ArenaAlloc::Alloc< char, countingAllocatorImpl,
+					ArenaAlloc::_slaballocimpl<countingAllocatorImpl> > > slabAllocFamily;
+typedef currentArenaFamily< ArenaAlloc::_memblockimpl<countingAllocatorImpl> > currentAllocFamily;
+
+template< template< typename > class Work >
+void runWorkload( reporter& out, const char * name, const std::vector<std::size_t>& threadCounts, int numOperations )
+{
+  for( std::size_t t = 0; t < threadCounts.size(); t++ )
+  {
+    std::size_t numThreads = threadCounts[t];
+    result used, r;
+    if( !forkCase<countingFamily>( &Work<countingFamily>::run, numThreads, numOperations, used ) )
+      used.m_reservedBytes = 0;
+
+    if( forkCase<stdAllocFamily>( &Work<stdAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "std::allocator", numThreads, r, used.m_reservedBytes );
+    if( forkCase<arenaAllocFamily>( &Work<arenaAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "Alloc", numThreads, r, used.m_reservedBytes );
+    if( forkCase<recycleAllocFamily>( &Work<recycleAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "RecycleAlloc", numThreads, r, used.m_reservedBytes );
+    if( forkCase<slabAllocFamily>( &Work<slabAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "SlabAlloc", numThreads, r, used.m_reservedBytes );
+    if( forkCase<currentAllocFamily>( &Work<currentAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "CurrentAlloc", numThreads, r, used.m_reservedBytes );
+#if __cplusplus >= 201703L
+    if( forkCase<monotonicFamily>( &Work<monotonicFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "pmr::monotonic_buffer_resource", numThreads, r, used.m_reservedBytes );
+    if( forkCase<arenaResourceAllocFamily>( &Work<arenaResourceAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "ArenaAlloc::memory_resource", numThreads, r, used.m_reservedBytes );
+    if( forkCase<recycleResourceAllocFamily>( &Work<recycleResourceAllocFamily>::run, numThreads, numOperations, r ) )
+      out.report( name, "ArenaAlloc::recycle_memory_resource", numThreads, r, used.m_reservedBytes );
+#endif
+  }
+}
+
+// adapts the workload function templates to runWorkload
+#define WORKLOAD( fn ) \
+  template< typename Family > struct fn##Case { static double run( int n ) { return fn<Family>( n ); } }
+
+WORKLOAD( mapWork );
+WORKLOAD( umapWork );
+WORKLOAD( vectorWork );
+WORKLOAD( listWork );
+WORKLOAD( stringWork );
+WORKLOAD( teardownWork );
+
+int main( int argc, char ** argv )
+{
+  int numOperations = 1000000;
+  bool json = false;
+  std::vector<std::size_t> threadCounts;
+
+  for( int i = 1; i < argc; i++ )
+  {
+    if( !strcmp( argv[i], "--ops" ) && i + 1 < argc )
+    {
+      numOperations = atoi( argv[++i] );
+    }
+    else if( !strcmp( argv[i], "--threads" ) && i + 1 < argc )
+    {
+      std::stringstream counts( argv[++i] );
+      std::string count;
+      while( std::getline( counts, count, ',' ) )
+	threadCounts.push_back( atoi( count.c_str() ) );
+    }
+    else if( !strcmp( argv[i], "--json" ) )
+    {
+      json = true;
+    }
+    else
+    {
+      std::cerr << "usage: " << argv[0] << " [--ops N] [--threads 1,2,4] [--json]" << std::endl;
+      return 1;
+    }
+  }
+
+  if( threadCounts.empty() )
+  {
+    std::size_t concurrency = std::thread::hardware_concurrency();
+    if( concurrency == 0 )
+      concurrency = 1;
+
+    for( std::size_t numThreads = 1; numThreads < concurrency; numThreads *= 2 )
+      threadCounts.push_back( numThreads );
+    threadCounts.push_back( concurrency );
   }
-  
-  std::cout << "Waiting a bit before waking the stalled threads" << std::endl;
-  std::this_thread::sleep_for( std::chrono::seconds( 5 ) );
-  
-  std::cout << "And they're off...!" << std::endl;
-  runBool = true;
-  cv.notify_all();
 
-  std::for_each( threads.begin(), threads.end(), std::mem_fn( &std::thread::join ) );  
+  reporter out( json );
+  runWorkload< mapWorkCase >( out, "map", threadCounts, numOperations );
+  runWorkload< umapWorkCase >( out, "umap", threadCounts, numOperations );
+  runWorkload< vectorWorkCase >( out, "vector", threadCounts, numOperations );
+  runWorkload< listWorkCase >( out, "list", threadCounts, numOperations );
+  runWorkload< stringWorkCase >( out, "string", threadCounts, numOperations );
+  runWorkload< teardownWorkCase >( out, "teardown", threadCounts, numOperations );
   return 0;
 }
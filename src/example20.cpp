@@ -0,0 +1,61 @@
+/*******************************************************************************
+ * example20.cpp
+ * Checkpoints in a long running loop.  Each pass keeps one small object
+ * and throws away the scratch work done under a mark, some of it carved
+ * from the region or slab the kept objects came from.  Built with
+ * ARENA_ALLOC_STATS the memory reserved by each kind of arena is checked
+ * to stop growing once the loop reaches a steady state.
+ *
+ * MIT license
+ *****************************************************************************/
+#define ARENA_ALLOC_STATS
+
+#include <iostream>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+#include "slaballoc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example20 example20.cpp
+
+template< typename AllocType >
+void work( AllocType& alloc, int passes )
+{
+  for( int pass = 0; pass < passes; pass++ )
+  {
+    alloc.allocate( 40 ); // long lived, i.e. a cache entry
+
+    ArenaAlloc::ArenaMark mark = alloc.mark();
+    for( int i = 0; i < 20; i++ )
+    {
+      char * scratch = alloc.allocate( 16 + i * 8 );
+      if( i % 4 == 0 )
+	alloc.deallocate( scratch, 16 + i * 8 );
+    }
+    alloc.rewind( mark );
+  }
+}
+
+template< typename AllocType >
+bool run( const char * name, AllocType alloc )
+{
+  work( alloc, 100 );
+  std::size_t reserved = alloc.getStats().m_reservedBytes;
+
+  work( alloc, 2000 );
+  ArenaAlloc::ArenaStats stats = alloc.getStats();
+
+  // the kept objects alone need a few more blocks at most
+  bool ok = stats.m_reservedBytes <= reserved + 2 * 65536;
+  std::cout << name << ": reserved " << reserved << " bytes after 100 passes, "
+	    << stats.m_reservedBytes << " after 2100, " << ( ok ? "bounded" : "GROWING" ) << std::endl;
+  return ok;
+}
+
+int main()
+{
+  bool ok = run( "Alloc", ArenaAlloc::Alloc<char>( 65536 ) );
+  ok = run( "RecycleAlloc", ArenaAlloc::RecycleAlloc<char>( 65536 ) ) && ok;
+  ok = run( "SizedRecycleAlloc", ArenaAlloc::SizedRecycleAlloc<char>( 65536 ) ) && ok;
+  ok = run( "SlabAlloc", ArenaAlloc::SlabAlloc<char>( 65536 ) ) && ok;
+  return ok ? 0 : 1;
+}
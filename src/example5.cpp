@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * example5.cpp
+ * Contention benchmark for the concurrent arena.  The map insert / erase
+ * work of example2.cpp is run on 1, 2, 4, ... hardware_concurrency()
+ * threads, each thread filling its own map, with node storage from:
+ * 1.  the standard STL allocator
+ * 2.  one ArenaAlloc::Alloc per thread
+ * 3.  a single ArenaAlloc::ConcurrentAlloc shared by every thread
+ *
+ * MIT license
+ *****************************************************************************/
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+#include <atomic>
+#include <stdlib.h>
+#include "arenaalloc.h"
+#include "concurrentalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example5 example5.cpp -lpthread
+// run as: ./example5 [numOperationsPerThread]
+
+typedef std::chrono::steady_clock clock_type;
+
+template< typename Map >
+void fillMap( Map& intToStrMap, const typename Map::mapped_type& value, int numOperations )
+{
+  for( int i = 0; i < numOperations; i++ )
+  {
+    intToStrMap.insert( typename Map::value_type( i, value ) );
+
+    if( i > 10 && ( i % 5 == 0 ) )
+      intToStrMap.erase( i - 5 );
+  }
+}
+
+struct stdWork
+{
+  void operator()( int numOperations )
+  {
+    std::map<int, std::string> intToStrMap;
+    fillMap( intToStrMap, std::string( "42" ), numOperations );
+  }
+};
+
+struct perThreadArenaWork
+{
+  void operator()( int numOperations )
+  {
+    typedef std::basic_string<char, std::char_traits<char>, ArenaAlloc::Alloc<char> > strtype;
+    ArenaAlloc::Alloc<char> alloc( 65536 );
+    std::map< int, strtype, std::less<int>, ArenaAlloc::Alloc<std::pair<const int,strtype> > >
+      intToStrMap( std::less<int>(), alloc );
+    fillMap( intToStrMap, strtype( "42", alloc ), numOperations );
+  }
+};
+
+struct sharedArenaWork
+{
+  ArenaAlloc::ConcurrentAlloc<char> m_alloc; // copied into each thread's functor
+
+  sharedArenaWork( const ArenaAlloc::ConcurrentAlloc<char>& alloc ):
+    m_alloc( alloc )
+  {
+  }
+
+  void operator()( int numOperations )
+  {
+    typedef std::basic_string<char, std::char_traits<char>, ArenaAlloc::ConcurrentAlloc<char> > strtype;
+    std::map< int, strtype, std::less<int>, ArenaAlloc::ConcurrentAlloc<std::pair<const int,strtype> > >
+      intToStrMap( std::less<int>(), m_alloc );
+    fillMap( intToStrMap, strtype( "42", m_alloc ), numOperations );
+  }
+};
+
+// runs work on numThreads threads started together and returns the
+// elapsed wall clock time in nanoseconds
+template< typename Work >
+double runThreads( Work work, std::size_t numThreads, int numOperations )
+{
+  std::atomic<std::size_t> ready( 0 );
+  std::atomic<bool> go( false );
+  std::vector< std::thread > threads;
+
+  for( std::size_t i = 0; i < numThreads; i++ )
+  {
+    threads.push_back( std::thread( [&ready, &go, work, numOperations]() mutable {
+	  ++ready;
+	  while( !go.load() )
+	    std::this_thread::yield();
+	  work( numOperations );
+	} ) );
+  }
+
+  while( ready.load() != numThreads )
+    std::this_thread::yield();
+
+  clock_type::time_point start = clock_type::now();
+  go = true;
+  for( std::size_t i = 0; i < threads.size(); i++ )
+    threads[i].join();
+
+  return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+int main( int argc, char ** argv )
+{
+  int numOperations = argc > 1 ? atoi( argv[1] ) : 1000000;
+  std::size_t concurrency = std::thread::hardware_concurrency();
+  if( concurrency == 0 )
+    concurrency = 1;
+
+  std::cout << "threads,std::allocator ns/op,per thread arena ns/op,shared concurrent arena ns/op,shared arena bytes" << std::endl;
+
+  for( std::size_t numThreads = 1; ; numThreads *= 2 )
+  {
+    if( numThreads > concurrency )
+      numThreads = concurrency;
+
+    double totalOps = double( numOperations ) * numThreads;
+    double stdTime = runThreads( stdWork(), numThreads, numOperations );
+    double arenaTime = runThreads( perThreadArenaWork(), numThreads, numOperations );
+
+    ArenaAlloc::ConcurrentAlloc<char> shared( 1024*1024 );
+    double sharedTime = runThreads( sharedArenaWork( shared ), numThreads, numOperations );
+
+    std::cout << numThreads << ","
+	      << stdTime / totalOps << ","
+	      << arenaTime / totalOps << ","
+	      << sharedTime / totalOps << ","
+	      << shared.getNumBytesAllocated() << std::endl;
+
+    if( numThreads == concurrency )
+      break;
+  }
+
+  return 0;
+}
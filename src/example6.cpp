@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * example6.cpp
+ * String churn.  A map of mixed size strings has random entries replaced
+ * over and over, the pattern under which an arena without reuse grows
+ * without bound.  Reports how much arena space each allocator needed
+ * against the bytes actually live at the end.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <functional>
+#include <stdlib.h>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example6 example6.cpp
+// run as: ./example6 [numReplacements]
+
+template< typename CharAlloc >
+void churn( const char * name, CharAlloc alloc, int numReplacements )
+{
+  typedef std::basic_string< char, std::char_traits<char>, CharAlloc > strtype;
+  typedef typename CharAlloc::template rebind< std::pair< const int, strtype > >::other mapalloc;
+  typedef std::map< int, strtype, std::less<int>, mapalloc > maptype;
+
+  const int numKeys = 10000;
+  srand( 42 );
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t liveBytes = 0;
+  {
+    mapalloc mapAllocator( alloc );
+    maptype strings( std::less<int>(), mapAllocator );
+    for( int i = 0; i < numReplacements; i++ )
+    {
+      int key = rand() % numKeys;
+      std::size_t length = 8 + rand() % ( rand() % 8 ? 128 : 2048 ); // mostly short, some long
+      strings.erase( key );
+      strings.insert( std::make_pair( key, strtype( length, 'x', alloc ) ) );
+    }
+
+    for( typename maptype::iterator itr = strings.begin(); itr != strings.end(); ++itr )
+      liveBytes += itr->second.capacity() + 1;
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << name << ": " << elapsed.count() << " ms, arena bytes " << alloc.getNumBytesAllocated()
+	    << ", live string bytes at end " << liveBytes << std::endl;
+}
+
+int main( int argc, char ** argv )
+{
+  int numReplacements = argc > 1 ? atoi( argv[1] ) : 2000000;
+
+  churn( "Alloc", ArenaAlloc::Alloc<char>( 65536 ), numReplacements );
+  churn( "RecycleAlloc", ArenaAlloc::RecycleAlloc<char>( 65536 ), numReplacements );
+  churn( "RecycleAlloc (geometric size classes)",
+	 ArenaAlloc::Alloc< char, ArenaAlloc::_newAllocatorImpl,
+			    ArenaAlloc::_recyclesizeclassimpl< ArenaAlloc::_newAllocatorImpl,
+							       ArenaAlloc::_geometricSizeClasses<> > >( 65536 ),
+	 numReplacements );
+  return 0;
+}
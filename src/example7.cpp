@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * example7.cpp
+ * Node container churn.  Runs the map insert / erase loop of example2.cpp
+ * plus random set and list churn, once per allocator:
+ * 1.  the standard STL allocator
+ * 2.  ArenaAlloc::Alloc
+ * 3.  ArenaAlloc::RecycleAlloc
+ * 4.  ArenaAlloc::SlabAlloc
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <list>
+#include <string>
+#include <functional>
+#include <stdlib.h>
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+#include "slaballoc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example7 example7.cpp
+// run as: ./example7 [numOperations]
+
+typedef std::chrono::steady_clock clock_type;
+
+// the allocator statistics of std::allocator are not available
+template< typename CharAlloc >
+std::size_t arenaBytes( CharAlloc& alloc ) { return alloc.getNumBytesAllocated(); }
+
+std::size_t arenaBytes( std::allocator<char>& ) { return 0; }
+
+template< typename CharAlloc >
+void churn( const char * name, CharAlloc alloc, int numOperations )
+{
+  typedef std::basic_string< char, std::char_traits<char>, CharAlloc > strtype;
+  typedef typename CharAlloc::template rebind< std::pair< const int, strtype > >::other mapalloc;
+  typedef typename CharAlloc::template rebind< int >::other intalloc;
+
+  clock_type::time_point start = clock_type::now();
+  {
+    // example2.cpp
+    mapalloc mapAllocator( alloc );
+    std::map< int, strtype, std::less<int>, mapalloc > intToStrMap( std::less<int>(), mapAllocator );
+    strtype answerToEverything( "42", alloc );
+    for( int i = 0; i < numOperations; i++ )
+    {
+      intToStrMap.insert( std::pair< const int, strtype >( i, answerToEverything ) );
+
+      if( i > 10 && ( i % 5 == 0 ) )
+	intToStrMap.erase( i - 5 );
+    }
+  }
+  double mapTime = std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+
+  start = clock_type::now();
+  {
+    intalloc intAllocator( alloc );
+    std::set< int, std::less<int>, intalloc > ints( std::less<int>(), intAllocator );
+    std::list< int, intalloc > fifo( intAllocator );
+    srand( 42 );
+    for( int i = 0; i < numOperations; i++ )
+    {
+      int key = rand() % 100000;
+      if( !ints.erase( key ) )
+	ints.insert( key );
+
+      fifo.push_back( key );
+      if( fifo.size() > 10000 )
+	fifo.pop_front();
+    }
+  }
+  double setTime = std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+
+  std::cout << name << ": map " << mapTime / numOperations << " ns/op, set and list "
+	    << setTime / numOperations << " ns/op, arena bytes " << arenaBytes( alloc ) << std::endl;
+}
+
+int main( int argc, char ** argv )
+{
+  int numOperations = argc > 1 ? atoi( argv[1] ) : 5000000;
+
+  churn( "std::allocator", std::allocator<char>(), numOperations );
+  churn( "Alloc", ArenaAlloc::Alloc<char>( 65536 ), numOperations );
+  churn( "RecycleAlloc", ArenaAlloc::RecycleAlloc<char>( 65536 ), numOperations );
+  churn( "SlabAlloc", ArenaAlloc::SlabAlloc<char>( 65536 ), numOperations );
+  return 0;
+}
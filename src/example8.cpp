@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * example8.cpp
+ * Page faults and TLB pressure of large arenas.  An arena of 64MB blocks
+ * is filled and then read at random, with blocks from:
+ * 1.  new char[]
+ * 2.  HugePageAllocatorImpl, transparent huge pages
+ * 3.  HugePageAllocatorImpl, transparent huge pages prefaulted
+ * 4.  HugePageAllocatorImpl, MAP_HUGETLB pages prefaulted when reserved
+ * Minor fault counts come from getrusage.  With huge pages the fill
+ * takes 512 times fewer faults, with prefaulting they are all taken
+ * when a block is allocated, and the random reads miss the TLB less often.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "arenaalloc.h"
+#include "mmapalloc.h"
+
+// compile as: g++ -O2 -std=c++11 -o example8 example8.cpp
+// run as: ./example8 [arenaMB]
+
+typedef std::chrono::steady_clock clock_type;
+
+static long minorFaults()
+{
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return usage.ru_minflt;
+}
+
+struct phase
+{
+  long m_faults;
+  clock_type::time_point m_start;
+
+  phase(): m_faults( minorFaults() ), m_start( clock_type::now() ) {}
+
+  void report( const char * name )
+  {
+    std::chrono::duration<double, std::milli> elapsed = clock_type::now() - m_start;
+    std::cout << " " << name << " " << elapsed.count() << " ms " << minorFaults() - m_faults << " faults,";
+  }
+};
+
+template< typename AllocatorImpl >
+void run( const char * name, AllocatorImpl impl, std::size_t arenaBytes )
+{
+  const std::size_t blockSize = 64*1024*1024;
+  const std::size_t chunkSize = 1024*1024;
+  std::cout << name << ":";
+
+  ArenaAlloc::Alloc< char, AllocatorImpl > alloc( blockSize, impl );
+  std::vector<char*> chunks;
+
+  // blocks are allocated when the first chunk of each is
+  phase allocation;
+  for( std::size_t i = 0; i < arenaBytes / chunkSize; i++ )
+    chunks.push_back( alloc.allocate( chunkSize ) );
+  allocation.report( "allocate" );
+
+  phase fill;
+  for( std::size_t i = 0; i < chunks.size(); i++ )
+    memset( chunks[i], 1, chunkSize );
+  fill.report( "fill" );
+
+  phase reads;
+  unsigned int seed = 42;
+  std::size_t sum = 0;
+  for( int i = 0; i < 20000000; i++ )
+    sum += chunks[ rand_r( &seed ) % chunks.size() ][ rand_r( &seed ) % chunkSize ];
+  reads.report( "random reads" );
+
+  std::cout << " checksum " << sum << std::endl;
+}
+
+int main( int argc, char ** argv )
+{
+  std::size_t arenaBytes = std::size_t( argc > 1 ? atoi( argv[1] ) : 1024 ) * 1024 * 1024;
+
+  run( "new char[]", ArenaAlloc::_newAllocatorImpl(), arenaBytes );
+  run( "transparent huge pages", ArenaAlloc::HugePageAllocatorImpl(), arenaBytes );
+  run( "transparent huge pages, prefaulted", ArenaAlloc::HugePageAllocatorImpl( true ), arenaBytes );
+  run( "MAP_HUGETLB, prefaulted", ArenaAlloc::HugePageAllocatorImpl( true, true ), arenaBytes );
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * example9.cpp
+ * Relocatable containers.  A lookup table, a vector of strings, is built
+ * with ArenaAlloc::OffsetAlloc in an arena carved from a shared memory
+ * file.  The file is then mapped a second time at another address, as
+ * a reader process would, and the table is read through that mapping
+ * with no copying or pointer fix ups.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "arenaalloc.h"
+#include "offsetptr.h"
+
+// compile as: g++ -O2 -std=c++11 -o example9 example9.cpp
+
+// bump allocates arena blocks from a mapping.  The small bookkeeping
+// allocations of the arena stay on the heap, they are not needed by readers.
+struct mappingAllocatorImpl
+{
+  char * m_base;
+  std::size_t m_size;
+  std::size_t * m_used; // kept in the mapping's header
+
+  void* allocate( size_t numBytes )
+  {
+    if( numBytes < 4096 )
+      return new char[ numBytes ];
+
+    if( *m_used + numBytes > m_size )
+      throw std::runtime_error( "Insufficient space in mapping" );
+
+    char * addr = m_base + *m_used;
+    *m_used += ( numBytes + 63 ) & ~63;
+    return addr;
+  }
+
+  void deallocate( void* ptr )
+  {
+    if( ptr < m_base || ptr >= m_base + m_size )
+      delete[]( (char*)ptr );
+  }
+};
+
+typedef std::basic_string< char, std::char_traits<char>, ArenaAlloc::OffsetAlloc<char, mappingAllocatorImpl> > strtype;
+typedef std::vector< strtype, ArenaAlloc::OffsetAlloc<strtype, mappingAllocatorImpl> > tabletype;
+
+// start of the mapping
+struct header
+{
+  std::size_t m_used;
+  ArenaAlloc::offset_ptr<tabletype> m_table;
+};
+
+int main()
+{
+  const std::size_t size = 64*1024*1024;
+  int fd = memfd_create( "example9", 0 );
+  if( fd < 0 || ftruncate( fd, size ) != 0 )
+    return 1;
+
+  char * writer = reinterpret_cast<char*>( mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) );
+  if( writer == MAP_FAILED )
+    return 1;
+
+  {
+    header * h = new ( writer ) header();
+    h->m_used = 4096; // the header's page
+
+    mappingAllocatorImpl impl = { writer, size, &h->m_used };
+    ArenaAlloc::OffsetAlloc<char, mappingAllocatorImpl> alloc( 1024*1024, impl );
+
+    // the table object itself is allocated from the arena too
+    ArenaAlloc::OffsetAlloc<tabletype, mappingAllocatorImpl> tableAlloc( alloc );
+    h->m_table = tableAlloc.allocate( 1 );
+    tabletype * table = new ( h->m_table.get() ) tabletype( tableAlloc );
+    for( int i = 0; i < 100000; i++ )
+      table->push_back( strtype( ( "entry " + std::to_string( i ) ).c_str(), alloc ) );
+
+    std::cout << "built " << table->size() << " entries at " << (void*)writer << std::endl;
+    // the arena's bookkeeping goes with alloc, the data stays in the mapping
+  }
+
+  // attach at a different address
+  char * reader = reinterpret_cast<char*>( mmap( 0, size, PROT_READ, MAP_SHARED, fd, 0 ) );
+  if( reader == MAP_FAILED )
+    return 1;
+  munmap( writer, size );
+
+  const header * h = reinterpret_cast<const header*>( reader );
+  const tabletype& table = *h->m_table;
+  std::cout << "read " << table.size() << " entries at " << (void*)reader
+	    << ", entry 4242 is \"" << table[4242].c_str() << "\"" << std::endl;
+
+  munmap( reader, size );
+  close( fd );
+  return 0;
+}
@@ -0,0 +1,105 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  memoryresource.h
+ **
+ **  std::pmr::memory_resource backed by an arena.  Requires c++17.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _ARENA_MEMORY_RESOURCE_H
+#define _ARENA_MEMORY_RESOURCE_H
+
+#include "arenaalloc.h"
+#include "recyclealloc.h"
+#include <memory_resource>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // Containers using std::pmr::polymorphic_allocator hold only a pointer
+  // to the resource.  Nodes, pmr::string and nested pmr containers all
+  // share its arena with no reference counting; the resource holds the
+  // one reference.  It must outlive every container using it.
+  //
+  // The arena can be any MemblockImpl, _recycleallocimpl to reuse
+  // freed memory, and may be shared with Alloc instances.
+  template< typename AllocatorImpl = _newAllocatorImpl,
+	    typename MemblockImpl = _memblockimpl<AllocatorImpl> >
+  class basic_memory_resource : public std::pmr::memory_resource
+  {
+  public:
+
+    typedef Alloc< char, AllocatorImpl, MemblockImpl > alloc_type;
+
+  private:
+
+    alloc_type m_alloc;
+
+    basic_memory_resource( const basic_memory_resource& );
+    basic_memory_resource& operator = ( const basic_memory_resource& );
+
+  public:
+
+    explicit basic_memory_resource( std::size_t defaultSize = 32768, AllocatorImpl allocImpl = AllocatorImpl() ):
+      m_alloc( defaultSize, allocImpl )
+    {
+    }
+
+    // allocates from the arena of an existing allocator
+    template< typename T >
+    explicit basic_memory_resource( const Alloc< T, AllocatorImpl, MemblockImpl >& alloc ):
+      m_alloc( alloc )
+    {
+    }
+
+    // an allocator sharing the arena
+    alloc_type get_alloc() const { return m_alloc; }
+
+    // These are extension functions forwarded to the arena
+    size_t getNumAllocations() { return m_alloc.getNumAllocations(); }
+    size_t getNumDeallocations() { return m_alloc.getNumDeallocations(); }
+    size_t getNumBytesAllocated() { return m_alloc.getNumBytesAllocated(); }
+#ifdef ARENA_ALLOC_STATS
+    ArenaStats getStats() const { return m_alloc.getStats(); }
+#endif
+    void setLargeThreshold( std::size_t numBytes ) { m_alloc.setLargeThreshold( numBytes ); }
+
+    ArenaMark mark() { return m_alloc.mark(); }
+    void rewind( const ArenaMark& m ) { m_alloc.rewind( m ); }
+
+    void reset( std::size_t maxRetainedBytes = std::numeric_limits<std::size_t>::max() )
+    {
+      m_alloc.reset( maxRetainedBytes );
+    }
+
+  protected:
+
+    void * do_allocate( std::size_t numBytes, std::size_t alignment )
+    {
+      void * ptr = m_alloc.allocateBytes( numBytes, alignment );
+      if( !ptr )
+	throw std::bad_alloc();
+
+      return ptr;
+    }
+
+    void do_deallocate( void * ptr, std::size_t numBytes, std::size_t alignment )
+    {
+      m_alloc.deallocateBytes( ptr, numBytes, alignment );
+    }
+
+    // resources are equal when they share an arena
+    bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept
+    {
+      const basic_memory_resource * resource = dynamic_cast< const basic_memory_resource* >( &other );
+      return resource && resource->m_alloc == m_alloc;
+    }
+  };
+
+  typedef basic_memory_resource<> memory_resource;
+  typedef basic_memory_resource< _newAllocatorImpl, _recycleallocimpl<_newAllocatorImpl> > recycle_memory_resource;
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  migrate.h
+ **
+ **  Deep copy of arena allocated containers into another arena, for
+ **  reclaiming the memory of a generation of data.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _MIGRATE_H
+#define _MIGRATE_H
+
+#include "arenaalloc.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <tuple>
+#include <utility>
+
+namespace ArenaAlloc
+{
+
+  // Copies a value into the arena of target.  Values of types which do
+  // not allocate from an arena of the same kind are copied as they are.
+  // The specialisations below rebuild containers allocating from such an
+  // arena, and the values within them, in the target arena.  Further
+  // types holding containers, i.e. structs, can be supported by
+  // specialising _migrate for them.
+  template< typename T, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate
+  {
+    static T copy( const T& value, const Alloc<char,AllocatorImpl,MemblockImpl>& )
+    {
+      return value;
+    }
+  };
+
+  template< typename A, typename B, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::pair<A,B>, AllocatorImpl, MemblockImpl >
+  {
+    static std::pair<A,B> copy( const std::pair<A,B>& value, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      return std::pair<A,B>( _migrate<A,AllocatorImpl,MemblockImpl>::copy( value.first, target ),
+			     _migrate<B,AllocatorImpl,MemblockImpl>::copy( value.second, target ) );
+    }
+  };
+
+  template< typename C, typename Traits, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::basic_string< C, Traits, Alloc<C,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+    typedef std::basic_string< C, Traits, Alloc<C,AllocatorImpl,MemblockImpl> > string_type;
+
+    static string_type copy( const string_type& value, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      return string_type( value.data(), value.size(), Alloc<C,AllocatorImpl,MemblockImpl>( target ) );
+    }
+  };
+
+  // Sequences are rebuilt in order, each element's own allocations
+  // following it.
+  template< typename Sequence, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrateSequence
+  {
+    static Sequence copy( const Sequence& value, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      typedef typename Sequence::value_type value_type;
+      Sequence result( ( typename Sequence::allocator_type( target ) ) );
+      reserve( result, value.size() );
+      for( typename Sequence::const_iterator itr = value.begin(); itr != value.end(); ++itr )
+	result.push_back( _migrate<value_type,AllocatorImpl,MemblockImpl>::copy( *itr, target ) );
+      return result;
+    }
+
+    template< typename T >
+    static void reserve( std::vector< T, Alloc<T,AllocatorImpl,MemblockImpl> >& result, std::size_t size )
+    {
+      result.reserve( size );
+    }
+
+    template< typename Other >
+    static void reserve( Other&, std::size_t ) {}
+  };
+
+  template< typename T, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::vector< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateSequence< std::vector< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename T, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::deque< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateSequence< std::deque< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename T, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::list< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateSequence< std::list< T, Alloc<T,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  // Ordered containers are rebuilt in iteration order so their nodes, and
+  // the allocations of the values in them, are laid out in the order a
+  // traversal visits them.  Inserting at the end makes each insert
+  // constant time.
+  template< typename Tree, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrateTree
+  {
+    static Tree copy( const Tree& value, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      Tree result( value.key_comp(), typename Tree::allocator_type( target ) );
+      for( typename Tree::const_iterator itr = value.begin(); itr != value.end(); ++itr )
+	insert( result, *itr, target );
+      return result;
+    }
+
+    // the key of a map element is const so the element is built in the
+    // node from the migrated key and value, which are moved rather than
+    // copied a second time through a pair.
+    template< typename K, typename V >
+    static void insert( Tree& result, const std::pair<const K,V>& element,
+			const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      result.emplace_hint( result.end(), std::piecewise_construct,
+			   std::forward_as_tuple( _migrate<K,AllocatorImpl,MemblockImpl>::copy( element.first, target ) ),
+			   std::forward_as_tuple( _migrate<V,AllocatorImpl,MemblockImpl>::copy( element.second, target ) ) );
+    }
+
+    template< typename K >
+    static void insert( Tree& result, const K& element, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      result.emplace_hint( result.end(), _migrate<K,AllocatorImpl,MemblockImpl>::copy( element, target ) );
+    }
+  };
+
+  template< typename K, typename V, typename Compare, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::map< K, V, Compare, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTree< std::map< K, V, Compare, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename V, typename Compare, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::multimap< K, V, Compare, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTree< std::multimap< K, V, Compare, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename Compare, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::set< K, Compare, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTree< std::set< K, Compare, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename Compare, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::multiset< K, Compare, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTree< std::multiset< K, Compare, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  // Hashed containers keep their bucket count so nothing is rehashed
+  // while they are rebuilt.
+  template< typename Table, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrateTable
+  {
+    static Table copy( const Table& value, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      Table result( value.bucket_count(), value.hash_function(), value.key_eq(),
+		    typename Table::allocator_type( target ) );
+      for( typename Table::const_iterator itr = value.begin(); itr != value.end(); ++itr )
+	insert( result, *itr, target );
+      return result;
+    }
+
+    template< typename K, typename V >
+    static void insert( Table& result, const std::pair<const K,V>& element,
+			const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      result.emplace( std::piecewise_construct,
+		      std::forward_as_tuple( _migrate<K,AllocatorImpl,MemblockImpl>::copy( element.first, target ) ),
+		      std::forward_as_tuple( _migrate<V,AllocatorImpl,MemblockImpl>::copy( element.second, target ) ) );
+    }
+
+    template< typename K >
+    static void insert( Table& result, const K& element, const Alloc<char,AllocatorImpl,MemblockImpl>& target )
+    {
+      result.emplace( _migrate<K,AllocatorImpl,MemblockImpl>::copy( element, target ) );
+    }
+  };
+
+  template< typename K, typename V, typename Hash, typename Equal, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::unordered_map< K, V, Hash, Equal, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTable< std::unordered_map< K, V, Hash, Equal, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename V, typename Hash, typename Equal, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::unordered_multimap< K, V, Hash, Equal, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTable< std::unordered_multimap< K, V, Hash, Equal, Alloc<std::pair<const K,V>,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename Hash, typename Equal, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::unordered_set< K, Hash, Equal, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTable< std::unordered_set< K, Hash, Equal, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  template< typename K, typename Hash, typename Equal, typename AllocatorImpl, typename MemblockImpl >
+  struct _migrate< std::unordered_multiset< K, Hash, Equal, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl > :
+    public _migrateTable< std::unordered_multiset< K, Hash, Equal, Alloc<K,AllocatorImpl,MemblockImpl> >, AllocatorImpl, MemblockImpl >
+  {
+  };
+
+  // Outcome of a migrate call.  The source arena's memory goes back to
+  // its allocator implementation once the last allocator sharing it,
+  // including those of any other containers in it, is gone.
+  struct MigrateResult
+  {
+    std::size_t m_sourceBytes; // getNumBytesAllocated() of the source arena
+    std::size_t m_targetBytes; // allocated from the target arena by the copy
+
+    std::size_t bytesReclaimed() const
+    {
+      return m_sourceBytes > m_targetBytes ? m_sourceBytes - m_targetBytes : 0;
+    }
+  };
+
+  // Replaces container with a deep copy in the arena of target.  Nested
+  // containers allocating from arenas of the same kind, i.e. the strings
+  // and vectors of a map< string, vector<string> >, are copied into the
+  // target arena too.  The copy is laid out in traversal order.  After
+  // the call container allocates from the target arena and the source
+  // arena may be released, i.e.
+  //   ArenaAlloc::Alloc<char> nextGeneration( 1024*1024 );
+  //   ArenaAlloc::MigrateResult result = ArenaAlloc::migrate( index, nextGeneration );
+  template< typename Container, typename T, typename AllocatorImpl, typename MemblockImpl >
+  MigrateResult migrate( Container& container, const Alloc<T,AllocatorImpl,MemblockImpl>& target )
+  {
+    Alloc<char,AllocatorImpl,MemblockImpl> to( target );
+    typename Container::allocator_type from( container.get_allocator() );
+
+    MigrateResult result;
+    result.m_sourceBytes = from.getNumBytesAllocated();
+    std::size_t before = to.getNumBytesAllocated();
+
+    Container migrated( _migrate<Container,AllocatorImpl,MemblockImpl>::copy( container, to ) );
+    container.swap( migrated ); // the allocators are swapped too, the old contents go with migrated
+
+    result.m_targetBytes = to.getNumBytesAllocated() - before;
+    return result;
+  }
+
+}
+
+#endif
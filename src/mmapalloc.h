@@ -0,0 +1,335 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  mmapalloc.h
+ **
+ **  Allocator implementations obtaining arena blocks directly from mmap.
+ **  Linux.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _MMAP_ALLOC_H
+#define _MMAP_ALLOC_H
+
+#include "arenaalloc.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // Sizes of the mappings handed out, since deallocate is given only the
+  // address.  Shared by every instance in the process.
+  struct _mappingTable
+  {
+    static std::mutex& mutex()
+    {
+      static std::mutex s_mutex;
+      return s_mutex;
+    }
+
+    static std::map< void*, std::size_t >& sizes()
+    {
+      static std::map< void*, std::size_t > s_sizes;
+      return s_sizes;
+    }
+  };
+
+  // AllocatorImpl backing arena blocks with huge pages.  Requests of at
+  // least a huge page, i.e. the blocks of arenas with a default size of
+  // 2MB or more, are mapped huge page aligned and rounded to whole huge
+  // pages.  They use MAP_HUGETLB pages when useHugeTlb is set and the
+  // system has them reserved, otherwise transparent huge pages requested
+  // with madvise( MADV_HUGEPAGE ).  With populate set the pages are
+  // faulted in when the block is allocated so that threads allocating
+  // from the arena later take no page faults.  Smaller requests, such as
+  // the arena's bookkeeping, come from operator new.
+  //
+  // Thread safe.
+  struct HugePageAllocatorImpl
+  {
+    static const std::size_t HugePageSize = 2*1024*1024;
+
+    bool m_populate;
+    bool m_useHugeTlb;
+
+    explicit HugePageAllocatorImpl( bool populate = false, bool useHugeTlb = false ):
+      m_populate( populate ),
+      m_useHugeTlb( useHugeTlb )
+    {
+    }
+
+    void* allocate( size_t numBytes )
+    {
+      if( numBytes < HugePageSize )
+	return new char[ numBytes ];
+
+      std::size_t mappedSize = _memblock<HugePageAllocatorImpl>::roundSize( numBytes, HugePageSize );
+      char * addr = 0;
+      if( m_useHugeTlb )
+	addr = mapHugeTlb( mappedSize );
+
+      if( !addr )
+	addr = mapTransparent( mappedSize );
+
+      std::lock_guard<std::mutex> lock( _mappingTable::mutex() );
+      _mappingTable::sizes()[ addr ] = mappedSize;
+      return addr;
+    }
+
+    void deallocate( void* ptr )
+    {
+      std::size_t mappedSize = 0;
+      {
+	std::lock_guard<std::mutex> lock( _mappingTable::mutex() );
+	std::map< void*, std::size_t >::iterator itr = _mappingTable::sizes().find( ptr );
+	if( itr != _mappingTable::sizes().end() )
+	{
+	  mappedSize = itr->second;
+	  _mappingTable::sizes().erase( itr );
+	}
+      }
+
+      if( mappedSize )
+	munmap( ptr, mappedSize );
+      else
+	delete[]( (char*)ptr );
+    }
+
+  private:
+
+    char * mapHugeTlb( std::size_t mappedSize )
+    {
+#ifdef MAP_HUGETLB
+      void * addr = mmap( 0, mappedSize, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | ( m_populate ? MAP_POPULATE : 0 ), -1, 0 );
+      if( addr != MAP_FAILED )
+	return reinterpret_cast<char*>( addr );
+#endif
+      return 0; // no huge pages reserved
+    }
+
+    // maps an extra huge page to find an aligned range, the slack either
+    // side is unmapped again.
+    char * mapTransparent( std::size_t mappedSize )
+    {
+      void * addr = mmap( 0, mappedSize + HugePageSize, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+      if( addr == MAP_FAILED )
+	throw std::bad_alloc();
+
+      char * raw = reinterpret_cast<char*>( addr );
+      char * aligned = _memblock<HugePageAllocatorImpl>::alignPtr( raw, HugePageSize );
+      if( aligned != raw )
+	munmap( raw, aligned - raw );
+      if( std::size_t tail = ( raw + mappedSize + HugePageSize ) - ( aligned + mappedSize ) )
+	munmap( aligned + mappedSize, tail );
+
+#ifdef MADV_HUGEPAGE
+      madvise( aligned, mappedSize, MADV_HUGEPAGE );
+#endif
+
+      // MAP_POPULATE at mmap time would fault the range in before the
+      // madvise and so with small pages.
+      if( m_populate )
+      {
+#ifdef MADV_POPULATE_WRITE
+	if( madvise( aligned, mappedSize, MADV_POPULATE_WRITE ) == 0 )
+	  return aligned;
+#endif
+	long pageSize = sysconf( _SC_PAGESIZE );
+	for( std::size_t offset = 0; offset < mappedSize; offset += pageSize )
+	  aligned[ offset ] = 0;
+      }
+
+      return aligned;
+    }
+  };
+
+  struct MMapAllocatorImpl;
+
+  // Virtual address space reserved up front and committed a block at a
+  // time, shared by every copy of an MMapAllocatorImpl.
+  struct _mmapReservation
+  {
+    std::mutex m_mutex;
+    std::size_t m_reserveSize;
+    std::size_t m_pageSize;
+    std::vector< std::pair< char*, std::size_t > > m_ranges; // every range reserved
+    char * m_cursor; // uncommitted remainder of the latest range
+    char * m_end;
+    std::map< char*, std::size_t > m_live; // committed ranges handed out
+    std::map< char*, std::size_t > m_released; // committed ranges whose pages went back to the OS
+    std::set< std::pair< std::size_t, char* > > m_releasedBySize; // the same, smallest first
+
+    explicit _mmapReservation( std::size_t reserveSize ):
+      m_reserveSize( reserveSize ),
+      m_pageSize( sysconf( _SC_PAGESIZE ) ),
+      m_cursor( 0 ),
+      m_end( 0 )
+    {
+      reserve( m_reserveSize );
+    }
+
+    ~_mmapReservation()
+    {
+      for( std::size_t i = 0; i < m_ranges.size(); i++ )
+	munmap( m_ranges[i].first, m_ranges[i].second );
+    }
+
+    void reserve( std::size_t numBytes )
+    {
+      void * addr = mmap( 0, numBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+      if( addr == MAP_FAILED )
+	throw std::bad_alloc();
+
+      m_cursor = reinterpret_cast<char*>( addr );
+      m_end = m_cursor + numBytes;
+      m_ranges.push_back( std::make_pair( m_cursor, numBytes ) );
+    }
+
+    char * allocate( std::size_t numBytes )
+    {
+      numBytes = _memblock<MMapAllocatorImpl>::roundSize( numBytes, m_pageSize );
+      std::lock_guard<std::mutex> lock( m_mutex );
+
+      // a released range is still committed, its pages come back zeroed
+      // on first touch.
+      char * addr = 0;
+      std::set< std::pair< std::size_t, char* > >::iterator itr =
+	m_releasedBySize.lower_bound( std::make_pair( numBytes, (char*)0 ) );
+      if( itr != m_releasedBySize.end() )
+      {
+	addr = itr->second;
+	std::size_t remaining = itr->first - numBytes;
+	eraseReleased( m_released.find( addr ) );
+	if( remaining )
+	  insertReleased( addr + numBytes, remaining );
+      }
+      else
+      {
+	// a full range is left behind rather than moved so existing
+	// allocations stay put.
+	if( std::size_t( m_end - m_cursor ) < numBytes )
+	  reserve( numBytes > m_reserveSize ? numBytes : m_reserveSize );
+
+	if( mprotect( m_cursor, numBytes, PROT_READ | PROT_WRITE ) != 0 )
+	  throw std::bad_alloc();
+
+	addr = m_cursor;
+	m_cursor += numBytes;
+      }
+
+      m_live[ addr ] = numBytes;
+      return addr;
+    }
+
+    // returns false when ptr was not allocated here
+    bool deallocate( void * ptr )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      std::map< char*, std::size_t >::iterator itr = m_live.find( reinterpret_cast<char*>( ptr ) );
+      if( itr == m_live.end() )
+	return false;
+
+      madvise( itr->first, itr->second, MADV_DONTNEED );
+      insertReleased( itr->first, itr->second );
+      m_live.erase( itr );
+      return true;
+    }
+
+    // released ranges are merged with their neighbours so blocks of
+    // different sizes released in turn do not fragment the reservation.
+    void insertReleased( char * addr, std::size_t numBytes )
+    {
+      std::map< char*, std::size_t >::iterator next = m_released.lower_bound( addr );
+      if( next != m_released.end() && addr + numBytes == next->first )
+      {
+	numBytes += next->second;
+	eraseReleased( next++ );
+      }
+
+      if( next != m_released.begin() )
+      {
+	std::map< char*, std::size_t >::iterator prev = next;
+	if( ( --prev )->first + prev->second == addr )
+	{
+	  addr = prev->first;
+	  numBytes += prev->second;
+	  eraseReleased( prev );
+	}
+      }
+
+      m_released[ addr ] = numBytes;
+      m_releasedBySize.insert( std::make_pair( numBytes, addr ) );
+    }
+
+    void eraseReleased( std::map< char*, std::size_t >::iterator itr )
+    {
+      m_releasedBySize.erase( std::make_pair( itr->second, itr->first ) );
+      m_released.erase( itr );
+    }
+  };
+
+  // AllocatorImpl committing arena blocks from address space reserved up
+  // front, without committing memory for it.  Arena blocks are
+  // committed from the reservation as they are allocated and when the
+  // arena releases a block, on clear(), reset() or destruction, its
+  // pages are returned to the OS with madvise( MADV_DONTNEED ) and the
+  // range is kept for reuse.  An arena whose generation has been
+  // discarded thus no longer pins its RSS.  Once the reservation is
+  // used up a further one is made, existing blocks never move.
+  // Requests smaller than a page, such as the arena's bookkeeping, come
+  // from operator new.
+  //
+  // By default every instance shares one process wide reservation of
+  // 16GB, made when the first is constructed, so arenas cost no address
+  // space of their own.  Constructed with reserveBytes an instance gets
+  // a reservation of its own instead, to keep a set of arenas apart or
+  // to size the reservation for them.  Copies share the reservation
+  // which lives until the last copy, and so the last arena using it, is
+  // gone.  Thread safe.
+  struct MMapAllocatorImpl
+  {
+    std::shared_ptr<_mmapReservation> m_reservation;
+
+    MMapAllocatorImpl():
+      m_reservation( shared() )
+    {
+    }
+
+    explicit MMapAllocatorImpl( std::size_t reserveBytes ):
+      m_reservation( std::make_shared<_mmapReservation>( reserveBytes ) )
+    {
+    }
+
+    static const std::shared_ptr<_mmapReservation>& shared()
+    {
+      static std::shared_ptr<_mmapReservation> s_reservation(
+	std::make_shared<_mmapReservation>( 16UL*1024*1024*1024 ) );
+      return s_reservation;
+    }
+
+    void* allocate( size_t numBytes )
+    {
+      if( numBytes < m_reservation->m_pageSize )
+	return new char[ numBytes ];
+
+      return m_reservation->allocate( numBytes );
+    }
+
+    void deallocate( void* ptr )
+    {
+      if( !m_reservation->deallocate( ptr ) )
+	delete[]( (char*)ptr );
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  offsetptr.h
+ **
+ **  Self relative fancy pointer and an arena allocator using it, so that
+ **  containers built in an arena stay valid when the memory holding them
+ **  is mapped at a different address.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _OFFSET_PTR_H
+#define _OFFSET_PTR_H
+
+#include "arenaalloc.h"
+#include <iterator>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace ArenaAlloc
+{
+
+  // Pointer holding the distance from itself to its target rather than
+  // the target's address.  Copying recomputes the distance so an
+  // offset_ptr is relocated along with what it points into.  An offset of
+  // 1 is null, a pointer is never 1 byte from an object it points to.
+  template< typename T >
+  class offset_ptr
+  {
+    std::ptrdiff_t m_offset;
+
+    static const std::ptrdiff_t NullOffset = 1;
+
+    struct _nat {};
+
+    typedef typename std::conditional< std::is_void<T>::value, _nat, T >::type object_type;
+
+    void set( const volatile void * ptr )
+    {
+      // integer arithmetic, the target and this are unrelated objects
+      m_offset = ptr ? std::ptrdiff_t( reinterpret_cast<std::uintptr_t>( ptr ) - reinterpret_cast<std::uintptr_t>( this ) ) : NullOffset;
+    }
+
+  public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef typename std::remove_cv<T>::type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef typename std::add_lvalue_reference<T>::type reference;
+    typedef T element_type;
+
+    template< typename U >
+    using rebind = offset_ptr<U>;
+
+    offset_ptr() : m_offset( NullOffset ) {}
+    offset_ptr( std::nullptr_t ) : m_offset( NullOffset ) {}
+    offset_ptr( T * ptr ) { set( ptr ); }
+    offset_ptr( const offset_ptr& src ) { set( src.get() ); }
+
+    template< typename U, typename = typename std::enable_if< std::is_convertible<U*, T*>::value >::type >
+    offset_ptr( const offset_ptr<U>& src ) { set( static_cast<T*>( src.get() ) ); }
+
+    // static_cast from void pointers as required of allocator pointers
+    template< typename U, typename = typename std::enable_if< !std::is_convertible<U*, T*>::value >::type,
+	      typename = void >
+    explicit offset_ptr( const offset_ptr<U>& src ) { set( static_cast<T*>( src.get() ) ); }
+
+    offset_ptr& operator = ( const offset_ptr& src ) { set( src.get() ); return *this; }
+    offset_ptr& operator = ( T * ptr ) { set( ptr ); return *this; }
+
+    T * get() const
+    {
+      return m_offset == NullOffset ? 0 :
+	reinterpret_cast<T*>( reinterpret_cast<std::uintptr_t>( this ) + m_offset );
+    }
+
+    static offset_ptr pointer_to( object_type& obj ) { return offset_ptr( &obj ); }
+
+    explicit operator bool() const { return m_offset != NullOffset; }
+
+    // libstdc++ converts its allocator's pointers to raw pointers implicitly
+    operator T * () const { return get(); }
+
+    reference operator * () const { return *get(); }
+    T * operator -> () const { return get(); }
+    reference operator [] ( difference_type n ) const { return get()[n]; }
+
+    offset_ptr& operator ++ () { m_offset += sizeof( object_type ); return *this; }
+    offset_ptr& operator -- () { m_offset -= sizeof( object_type ); return *this; }
+    offset_ptr operator ++ ( int ) { offset_ptr tmp( *this ); ++*this; return tmp; }
+    offset_ptr operator -- ( int ) { offset_ptr tmp( *this ); --*this; return tmp; }
+    offset_ptr& operator += ( difference_type n ) { m_offset += n * difference_type( sizeof( object_type ) ); return *this; }
+    offset_ptr& operator -= ( difference_type n ) { m_offset -= n * difference_type( sizeof( object_type ) ); return *this; }
+
+
+    // templates so they match integers of any type exactly and are
+    // preferred over the built in operators reached through operator T*
+    template< typename I, typename = typename std::enable_if< std::is_integral<I>::value >::type >
+    friend offset_ptr operator + ( const offset_ptr& p, I n ) { return offset_ptr( p.get() + n ); }
+    template< typename I, typename = typename std::enable_if< std::is_integral<I>::value >::type >
+    friend offset_ptr operator + ( I n, const offset_ptr& p ) { return offset_ptr( p.get() + n ); }
+    template< typename I, typename = typename std::enable_if< std::is_integral<I>::value >::type >
+    friend offset_ptr operator - ( const offset_ptr& p, I n ) { return offset_ptr( p.get() - n ); }
+    friend difference_type operator - ( const offset_ptr& a, const offset_ptr& b ) { return a.get() - b.get(); }
+
+    friend bool operator == ( const offset_ptr& a, const offset_ptr& b ) { return a.get() == b.get(); }
+    friend bool operator != ( const offset_ptr& a, const offset_ptr& b ) { return a.get() != b.get(); }
+    friend bool operator < ( const offset_ptr& a, const offset_ptr& b ) { return a.get() < b.get(); }
+    friend bool operator > ( const offset_ptr& a, const offset_ptr& b ) { return a.get() > b.get(); }
+    friend bool operator <= ( const offset_ptr& a, const offset_ptr& b ) { return a.get() <= b.get(); }
+    friend bool operator >= ( const offset_ptr& a, const offset_ptr& b ) { return a.get() >= b.get(); }
+    friend bool operator == ( const offset_ptr& a, std::nullptr_t ) { return !a; }
+    friend bool operator != ( const offset_ptr& a, std::nullptr_t ) { return !!a; }
+    friend bool operator == ( std::nullptr_t, const offset_ptr& a ) { return !a; }
+    friend bool operator != ( std::nullptr_t, const offset_ptr& a ) { return !!a; }
+  };
+
+  // Arena allocator whose pointer type is offset_ptr<T>.  A container
+  // built with it, placed in memory from the same arena, can be mapped
+  // at another address, i.e. in another process, and used there without
+  // fixing up pointers as long as the whole arena moves together and
+  // nothing is allocated or freed through the copy.  The arena's own
+  // block list is not relocatable.
+  //
+  // The STL decides which of its internal pointers use the allocator's
+  // pointer type.  With libstdc++ vector and basic_string store
+  // offset_ptrs throughout.  Node based containers accept the allocator
+  // but keep raw pointers between their nodes and so are not relocatable.
+  template< typename T, typename AllocatorImpl = _newAllocatorImpl,
+	    typename MemblockImpl = _memblockimpl<AllocatorImpl> >
+  class OffsetAlloc : public Alloc< T, AllocatorImpl, MemblockImpl >
+  {
+    typedef Alloc< T, AllocatorImpl, MemblockImpl > base_t;
+
+  public:
+    typedef offset_ptr<T> pointer;
+    typedef offset_ptr<const T> const_pointer;
+    typedef offset_ptr<void> void_pointer;
+    typedef offset_ptr<const void> const_void_pointer;
+
+    // rebind allocator to type U
+    template <class U>
+    struct rebind {
+      typedef OffsetAlloc<U,AllocatorImpl,MemblockImpl> other;
+    };
+
+    OffsetAlloc( std::size_t defaultSize = 32768, AllocatorImpl allocImpl = AllocatorImpl() ) throw():
+      base_t( defaultSize, allocImpl )
+    {
+    }
+
+    template <class U>
+    OffsetAlloc( const Alloc<U,AllocatorImpl,MemblockImpl>& src ) throw():
+      base_t( src )
+    {
+    }
+
+    pointer allocate( std::size_t num, const void* = 0 )
+    {
+      return pointer( base_t::allocate( num ) );
+    }
+
+    void deallocate( pointer p, std::size_t num )
+    {
+      base_t::deallocate( p.get(), num );
+    }
+  };
+
+}
+
+#endif
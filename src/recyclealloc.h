@@ -16,27 +16,141 @@
 namespace ArenaAlloc
 {
   
+  // Size class policies for _recyclesizeclassimpl.  classOf() maps a chunk
+  // size (header included) to the smallest class whose chunks can hold it
+  // and classSize() is the chunk size of a class.  Chunks past the last class
+  // are kept on a single oversize list.  Class sizes that are multiples
+  // of 16 keep payloads 16 byte aligned, multiples of 8 pack denser.
+  
+  // NumClasses classes StepSize bytes apart.  The default covers chunks
+  // of up to 4KB.
+  template< std::size_t StepSize = 16, std::size_t NumClasses = 256 >
+  struct _linearSizeClasses
+  {
+    static_assert( StepSize >= 8 && !( StepSize & ( StepSize - 1 ) ), "Step size must be a power of 2 >= 8" );
+    
+    static const std::size_t numClasses = NumClasses;
+    
+    static std::size_t classOf( std::size_t size ) { return ( size + StepSize - 1 ) / StepSize - 1; }
+    static std::size_t classSize( std::size_t cls ) { return ( cls + 1 ) * StepSize; }
+  };
+  
+  inline std::size_t _log2floor( std::size_t value )
+  {
+    return sizeof( unsigned long long ) * 8 - 1 - __builtin_clzll( value );
+  }
+  
+  // Powers of 2 from MinSize.  Few classes and fast to compute at the cost
+  // of up to 50% internal fragmentation.
+  template< std::size_t MinSize = 16, std::size_t NumClasses = 24 >
+  struct _pow2SizeClasses
+  {
+    static_assert( MinSize >= 8 && !( MinSize & ( MinSize - 1 ) ), "Min size must be a power of 2 >= 8" );
+    
+    static const std::size_t numClasses = NumClasses;
+    
+    static std::size_t classOf( std::size_t size ) 
+    { 
+      return size <= MinSize ? 0 : _log2floor( size - 1 ) + 1 - _log2floor( MinSize );
+    }
+    
+    static std::size_t classSize( std::size_t cls ) { return MinSize << cls; }
+  };
+  
+  // jemalloc style classes.  Linear steps of MinSize up to 4*MinSize then
+  // 4 classes per doubling, bounding internal fragmentation at 20%.
+  template< std::size_t MinSize = 16, std::size_t NumClasses = 88 >
+  struct _geometricSizeClasses
+  {
+    static_assert( MinSize >= 8 && !( MinSize & ( MinSize - 1 ) ), "Min size must be a power of 2 >= 8" );
+    
+    static const std::size_t numClasses = NumClasses;
+    
+    static std::size_t classOf( std::size_t size )
+    {
+      if( size <= 4*MinSize )
+	return size <= MinSize ? 0 : ( size + MinSize - 1 ) / MinSize - 1;
+      
+      // 2^k < size <= 2^(k+1) split into 4 steps of 2^(k-2)
+      std::size_t k = _log2floor( size - 1 );
+      std::size_t step = std::size_t( 1 ) << ( k - 2 );
+      std::size_t j = ( size - ( std::size_t( 1 ) << k ) + step - 1 ) / step; // 1..4
+      return 4 + ( k - _log2floor( 4*MinSize ) ) * 4 + j - 1;
+    }
+    
+    static std::size_t classSize( std::size_t cls )
+    {
+      if( cls < 4 )
+	return ( cls + 1 ) * MinSize;
+      
+      std::size_t k = _log2floor( 4*MinSize ) + ( cls - 4 ) / 4;
+      return ( std::size_t( 1 ) << k ) + ( ( cls - 4 ) % 4 + 1 ) * ( std::size_t( 1 ) << ( k - 2 ) );
+    }
+  };
+  
   // todo:
   // attempt refactor of boilerplate in _memblockimpl and _recycleallocimpl
-  template< typename AllocatorImpl, uint16_t StepSize = 16, uint16_t NumBuckets = 256 >
-  struct _recycleallocimpl : public _memblockimplbase<AllocatorImpl, _recycleallocimpl<AllocatorImpl> >
+  //
+  // Chunks are carved from regions obtained from the arena's blocks.  Each
+  // chunk starts with a header holding its size and two flags: whether the
+  // chunk is in use and whether the chunk physically before it is.  A free
+  // chunk repeats its size in its last word (the boundary tag) so a chunk
+  // being freed can find and merge with a free predecessor as well as a
+  // free successor.  Free chunks larger than a request are split and the
+  // remainder goes back on the free lists.  The unused end of the current
+  // region (the top) grows back when the chunk before it is freed, so no
+  // two free chunks are ever adjacent and the chunk before the top is
+  // always in use.  Every region ends in a permanently in use fence header.
+  //
+  // With SizedDeallocation the size passed to deallocate by the STL is
+  // used instead and chunks carry no header at all, which keeps small
+  // nodes denser.  Free chunks can then still be split and given back to
+  // the top but not merged with their neighbours, whose state is unknown.
+  // Sized mode requires every deallocate call to pass the size it
+  // allocated, which Alloc always does.
+  template< typename AllocatorImpl, typename SizeClasses = _linearSizeClasses<>,
+	    typename RefCountPolicy = _plainRefCount, bool SizedDeallocation = false >
+  struct _recyclesizeclassimpl : 
+    public _memblockimplbase<AllocatorImpl, 
+			     _recyclesizeclassimpl<AllocatorImpl, SizeClasses, RefCountPolicy, SizedDeallocation>, 
+			     sizeof( _roundsize ), RefCountPolicy >
   {     
   private:
     
-    static_assert( ( StepSize >= 16 && NumBuckets >= 16 ), "Min step size=16, Min num buckets=16" );
-    static_assert( !( StepSize & ( StepSize - 1 ) ), "Step size must be a power of 2" );
+    static const std::size_t NumClasses = SizeClasses::numClasses;
+    static const std::size_t NumWords = ( NumClasses + 63 ) / 64;
+    static const std::size_t HeaderSize = SizedDeallocation ? 0 : sizeof( std::size_t );
+    static const std::size_t Granularity = 8; // chunk sizes are a multiple of this
+    static const std::size_t RegionAlignment = 16; // with the header keeps payloads 16 byte aligned
+    
+    // header flags kept in the low bits of the chunk size
+    static const std::size_t InUse = 1;
+    static const std::size_t PrevInUse = 2;
+    static const std::size_t FlagMask = Granularity - 1;
+    
+    static_assert( NumClasses >= 1, "At least one size class is required" );
     
     struct _freeEntry
     {
       // note: order of declaration matters
-      std::size_t m_size;
+      std::size_t m_head; // size | flags
       _freeEntry * m_next;      
+      _freeEntry * m_prev;
     };
     
-    _freeEntry * m_buckets[ NumBuckets ]; // m_buckets[ NumBuckets - 1 ] is the oversize bucket
+    // size, list links and the trailing size tag when boundary tags are kept
+    static const std::size_t MinChunk = sizeof( _freeEntry ) + ( SizedDeallocation ? 0 : sizeof( std::size_t ) );
     
-    typedef struct _memblockimplbase< AllocatorImpl, _recycleallocimpl<AllocatorImpl> > base_t;
-    friend struct _memblockimplbase< AllocatorImpl, _recycleallocimpl<AllocatorImpl> >;
+    _freeEntry * m_buckets[ NumClasses ]; // chunks of class i are at least classSize( i ) bytes
+    _freeEntry * m_oversize; // chunks larger than the largest class
+    uint64_t m_occupied[ NumWords ]; // bit i is set when m_buckets[ i ] is non empty
+    
+    char * m_top; // unused end of the current region
+    char * m_topEnd; // fence of the current region
+    std::size_t m_regionSize;
+    
+    typedef struct _memblockimplbase< AllocatorImpl, _recyclesizeclassimpl, sizeof( _roundsize ), RefCountPolicy > base_t;
+    friend struct _memblockimplbase< AllocatorImpl, _recyclesizeclassimpl, sizeof( _roundsize ), RefCountPolicy >;
     
     // to get around some sticky access issues between Alloc<T1> and Alloc<T2> when sharing
     // the implementation.
@@ -44,141 +158,502 @@ namespace ArenaAlloc
     friend class Alloc;
     
     template< typename T >
-    static void assign( const Alloc<T,AllocatorImpl, _recycleallocimpl<AllocatorImpl> >& src, 
-			  _recycleallocimpl *& dest )
+    static void assign( const Alloc<T,AllocatorImpl, _recyclesizeclassimpl >& src, 
+			  _recyclesizeclassimpl *& dest )
     {
-      dest = const_cast< _recycleallocimpl<AllocatorImpl>* >( src.m_impl );
+      dest = const_cast< _recyclesizeclassimpl* >( src.m_impl );
     }
         
-    static _recycleallocimpl<AllocatorImpl> * create( std::size_t defaultSize, AllocatorImpl& alloc )
+    static _recyclesizeclassimpl * create( std::size_t defaultSize, AllocatorImpl& alloc )
     {
       return new ( 
-	alloc.allocate( sizeof( _recycleallocimpl ) ) ) _recycleallocimpl<AllocatorImpl>( defaultSize, 
-											  alloc );
+	alloc.allocate( sizeof( _recyclesizeclassimpl ) ) ) _recyclesizeclassimpl( defaultSize, alloc );
     }
    
-    static void destroy( _recycleallocimpl<AllocatorImpl> * objToDestroy )
+    static void destroy( _recyclesizeclassimpl * objToDestroy )
     {      
       AllocatorImpl allocImpl = objToDestroy->m_alloc;
-      objToDestroy-> ~_recycleallocimpl<AllocatorImpl>();
+      objToDestroy-> ~_recyclesizeclassimpl();
       allocImpl.deallocate( objToDestroy );      
     }
     
-    _recycleallocimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
-      _memblockimplbase<AllocatorImpl, _recycleallocimpl<AllocatorImpl> >( defaultSize, allocImpl )
+    _recyclesizeclassimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
+      base_t( defaultSize, allocImpl )
     {
-      memset( m_buckets, 0, sizeof( m_buckets ) );
+      // two regions fit in a default sized block after its alignment loss
+      m_regionSize = base_t::m_defaultSize / 2 - _memblock<AllocatorImpl>::BlockAlignment;
+      clearFreeLists();
 
 #ifdef ARENA_ALLOC_DEBUG
-      fprintf( stdout, "_recycleallocimpl=%p constructed with default size=%ld\n", this, 
+      fprintf( stdout, "_recyclesizeclassimpl=%p constructed with default size=%ld\n", this, 
 	       base_t::m_defaultSize );
 #endif
     }
   
-    ~_recycleallocimpl( )
+    ~_recyclesizeclassimpl( )
     {
 #ifdef ARENA_ALLOC_DEBUG
-      fprintf( stdout, "~_recycleallocimpl() called on _recycleallocimpl=%p\n", this );
+      fprintf( stdout, "~_recyclesizeclassimpl() called on _recyclesizeclassimpl=%p\n", this );
 #endif      
       base_t::clear();
     }  
 
-    char * allocate( std::size_t numBytes )
+    void clearFreeLists()
+    {
+      memset( m_buckets, 0, sizeof( m_buckets ) );
+      memset( m_occupied, 0, sizeof( m_occupied ) );
+      m_oversize = 0;
+      m_top = m_topEnd = 0;
+    }
+    
+    static std::size_t& head( char * chunk ) { return *reinterpret_cast<std::size_t*>( chunk ); }
+    static std::size_t sizeOf( char * chunk ) { return head( chunk ) & ~FlagMask; }
+    static std::size_t& foot( char * chunk, std::size_t size ) 
+    { 
+      return *reinterpret_cast<std::size_t*>( chunk + size - sizeof( std::size_t ) ); 
+    }
+    
+    static std::size_t roundChunk( std::size_t size )
+    {
+      size = ( size + Granularity - 1 ) & ~( Granularity - 1 );
+      return size < MinChunk ? MinChunk : size;
+    }
+    
+    // chunks are rounded up to their class size so any chunk of a class
+    // satisfies any request mapping to it.  In sized mode this must give
+    // the same result at deallocation.
+    static std::size_t chunkSizeOf( std::size_t numBytes )
+    {
+      std::size_t chunkSize = numBytes + HeaderSize;
+      std::size_t cls = SizeClasses::classOf( chunkSize );
+      return roundChunk( cls < NumClasses ? SizeClasses::classSize( cls ) : chunkSize );
+    }
+    
+    char * allocate( std::size_t numBytes, std::size_t alignment = sizeof( std::size_t ) )
     {      
+      if( alignment > sizeof( std::size_t ) )
+	return allocateAligned( numBytes, alignment );
       
-      numBytes = ( (numBytes + sizeof( std::size_t ) + StepSize - 1) / StepSize ) * StepSize;
+      std::size_t chunkSize = chunkSizeOf( numBytes );
+      char * chunk = allocateChunk( chunkSize, SizeClasses::classOf( chunkSize ) );
+      if( !chunk )
+	return 0; // allocation failure
       
-      char * returnValue = allocateInternal( numBytes );
-      if( !returnValue )
+      ++ base_t::m_numAllocate;
+#ifdef ARENA_ALLOC_STATS
+      base_t::recordRequest( numBytes );
+#endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceAllocate, this, numBytes, chunk + HeaderSize );
+#endif
+      return chunk + HeaderSize;
+    }
+    
+    // over-aligned requests take a chunk with enough slack to find an
+    // aligned payload within it.  The slack before and after is split off
+    // and freed.
+    char * allocateAligned( std::size_t numBytes, std::size_t alignment )
+    {
+      std::size_t chunkSize = chunkSizeOf( numBytes );
+      // the lead is less than alignment + MinChunk so in sized mode a
+      // further MinChunk guarantees the tail can be split off as well
+      std::size_t paddedSize = roundChunk( chunkSize + alignment + ( SizedDeallocation ? 2 : 1 ) * MinChunk );
+      char * chunk = allocateChunk( paddedSize, SizeClasses::classOf( paddedSize ) );
+      if( !chunk )
+	return 0;
+      
+      char * payload = chunk + HeaderSize;
+      char * aligned = _memblock<AllocatorImpl>::alignPtr( payload, alignment );
+      if( aligned != payload && std::size_t( aligned - payload ) < MinChunk )
+	aligned = _memblock<AllocatorImpl>::alignPtr( payload + MinChunk, alignment );
+      
+      if( aligned != payload )
       {
-	char * allocValue = base_t::allocate( numBytes );
+	// the leading slack becomes a free chunk.  its predecessor is in use.
+	std::size_t lead = aligned - payload;
+	std::size_t size = sizeOf( chunk );
+	head( chunk ) = lead | PrevInUse;
+	if( !SizedDeallocation )
+	  foot( chunk, lead ) = lead;
+	insertFree( chunk );
 	
-	if( !allocValue )
-	  return 0; //allocation failure
-
-	*((std::size_t*)allocValue ) = numBytes; // that includes the header
-	return allocValue + sizeof( std::size_t );
+	chunk += lead;
+	head( chunk ) = ( size - lead ) | InUse;
       }
       
-      return returnValue;
+      trim( chunk, chunkSize );
+      ++ base_t::m_numAllocate;
+#ifdef ARENA_ALLOC_STATS
+      base_t::recordRequest( numBytes );
+#endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceAllocate, this, numBytes, chunk + HeaderSize );
+#endif
+      return chunk + HeaderSize;
+    }
+    
+    // the alignment is not needed, allocateAligned trims an over-aligned
+    // chunk to the chunk size of its request so in sized mode the header
+    // rebuilt is the same as for any other allocation of numBytes.
+    void deallocate( void * ptr, std::size_t numBytes, std::size_t = sizeof( std::size_t ) )
+    {
+      char * chunk = reinterpret_cast<char*>( ptr ) - HeaderSize;
+      if( SizedDeallocation )
+	head( chunk ) = chunkSizeOf( numBytes ); // rebuilds the header it never had
+      
+      freeChunk( chunk );
+      base_t::countDeallocation( ptr, numBytes );
     }
     
     void deallocate( void * ptr )
     {      
-      deallocateInternal( reinterpret_cast<char*>(ptr) );
-      base_t::deallocate( ptr ); // this is called b/c it is known this just updates stats
+      static_assert( !SizedDeallocation, "sized deallocation requires the size of the allocation" );
+      freeChunk( reinterpret_cast<char*>( ptr ) - HeaderSize );
+      base_t::countDeallocation( ptr, 0 );
     }
 
-    char * allocateInternal( std::size_t numBytes )
-    {      
-      // numBytes must already be rounded to a multiple of stepsize and have an
-      // extra sizeof( std::size_t ) bytes tacked on for the header
-      // pointer returned points sizeof( std::size_t ) bytes into the allocation
-      // bucket 0 is always null in this scheme. 
+    // chunks are reused by size, they never change size in place
+    bool tryExpand( void *, std::size_t, std::size_t )
+    {
+      return false;
+    }
+
+    // the mark keeps the top so the chunks carved from it afterwards are
+    // taken back by the rewind.  Chunks free at the mark and reused after
+    // it are not, the rewind only recovers memory carved since.
+    ArenaMark mark() const
+    {
+      ArenaMark mark = base_t::mark();
+      mark.m_top = m_top;
+      mark.m_topEnd = m_topEnd;
+      return mark;
+    }
+    
+    // the free lists are rebuilt from the chunks lying before the mark and
+    // outside the top it kept.  Regions are never split by the blocks'
+    // mark so the neighbours of a chunk kept are kept as well and
+    // coalescing with them stays safe.  The current top is retired first
+    // to give the end of its region a proper header, and a free chunk
+    // running into the top kept is taken back into it.
+    void rewind( const ArenaMark& mark )
+    {
+      if( !base_t::validMark( mark ) )
+	return;
       
-      uint16_t bucketNumber = numBytes / StepSize;
+      if( m_top )
+	retireTop();
       
-      if( bucketNumber > NumBuckets - 1 )
-	bucketNumber = NumBuckets - 1; // oversize alloc
+      _freeEntry * chunks = 0;
+      for( std::size_t cls = 0; cls <= NumClasses; cls++ )
+      {
+	_freeEntry * entry = cls < NumClasses ? m_buckets[ cls ] : m_oversize;
+	while( entry )
+	{
+	  _freeEntry * next = entry->m_next;
+	  entry->m_next = chunks;
+	  chunks = entry;
+	  entry = next;
+	}
+      }
       
-      // search max 3 consecutive buckets for an item large enough.
-      // in the oversize bucket and only in the oversize bucket,
-      // search upto 3 items into the linked list for an entry
-      // large enough for the specified size
-      for( uint16_t bkt = bucketNumber, i = 0; i < 3 && bkt < NumBuckets; ++i, ++bkt )
+      clearFreeLists();
+      char * top = mark.m_top;
+      while( chunks )
       {
-	if( m_buckets[ bkt ] )
-	  return allocateFrom( numBytes, m_buckets[ bkt ] );
+	_freeEntry * next = chunks->m_next;
+	char * chunk = reinterpret_cast<char*>( chunks );
+	if( base_t::precedes( chunk, mark ) && !( chunk >= mark.m_top && chunk < mark.m_topEnd ) )
+	{
+	  if( chunk < mark.m_top && chunk + sizeOf( chunk ) >= mark.m_top )
+	    top = chunk;
+	  else
+	    insertFree( chunk );
+	}
+	chunks = next;
       }
       
-      return 0;
+      base_t::rewind( mark );
+      m_top = top;
+      m_topEnd = mark.m_topEnd;
     }
-
-    char * allocateFrom( std::size_t numBytes, _freeEntry *& head )
+    
+    // nothing survives a reset so the free lists are simply dropped
+    void reset( std::size_t maxRetainedBytes )
+    {
+      clearFreeLists();
+      base_t::reset( maxRetainedBytes );
+    }
+    
+    // file under the largest class the chunk can fully serve.  Chunks
+    // beyond the last class or smaller than the first go on the oversize list.
+    std::size_t binOf( std::size_t size )
+    {
+      std::size_t cls = SizeClasses::classOf( size );
+      if( cls < NumClasses && SizeClasses::classSize( cls ) > size )
+	return cls ? cls - 1 : NumClasses;
+      
+      return cls;
+    }
+    
+    void insertFree( char * chunk )
+    {
+      _freeEntry * entry = reinterpret_cast<_freeEntry*>( chunk );
+      std::size_t cls = binOf( sizeOf( chunk ) );
+      _freeEntry *& bin = cls < NumClasses ? m_buckets[ cls ] : m_oversize;
+      
+      entry->m_prev = 0;
+      entry->m_next = bin;
+      if( bin )
+	bin->m_prev = entry;
+      bin = entry;
+      
+      if( cls < NumClasses )
+	m_occupied[ cls / 64 ] |= uint64_t( 1 ) << ( cls % 64 );
+    }
+    
+    void unlinkFree( char * chunk )
+    {
+      _freeEntry * entry = reinterpret_cast<_freeEntry*>( chunk );
+      if( entry->m_next )
+	entry->m_next->m_prev = entry->m_prev;
+      
+      if( entry->m_prev )
+      {
+	entry->m_prev->m_next = entry->m_next;
+	return;
+      }
+      
+      std::size_t cls = binOf( sizeOf( chunk ) );
+      if( cls < NumClasses )
+      {
+	m_buckets[ cls ] = entry->m_next;
+	if( !entry->m_next )
+	  m_occupied[ cls / 64 ] &= ~( uint64_t( 1 ) << ( cls % 64 ) );
+      }
+      else
+      {
+	m_oversize = entry->m_next;
+      }
+    }
+    
+    // first non empty class >= cls or NumClasses if there is none
+    std::size_t findClass( std::size_t cls ) const
+    {
+      std::size_t word = cls / 64;
+      uint64_t bits = m_occupied[ word ] & ( ~uint64_t( 0 ) << ( cls % 64 ) );
+      
+      while( !bits )
+      {
+	if( ++word == NumWords )
+	  return NumClasses;
+	bits = m_occupied[ word ];
+      }
+      
+      return word * 64 + __builtin_ctzll( bits );
+    }
+    
+    // whether a free chunk of size bytes can be trimmed to exactly
+    // chunkSize.  In sized mode a remainder too small to be split off
+    // would stay with the chunk and be lost when it is deallocated with
+    // the size of the request, so such chunks are passed over.
+    static bool fits( std::size_t size, std::size_t chunkSize )
+    {
+      return size == chunkSize || size >= chunkSize + ( SizedDeallocation ? MinChunk : 0 );
+    }
+    
+    // returns an in use chunk of exactly chunkSize bytes.  cls is the size
+    // class of the request or NumClasses when it has none.
+    char * allocateChunk( std::size_t chunkSize, std::size_t cls )
     {      
-      _freeEntry * current = head;
-      _freeEntry * prev = 0;
+      char * chunk = 0;
       
-      int count = 0;
-
-      while( current && count < 3 )
+      if( cls < NumClasses )
       {
-	if( current->m_size >= numBytes )
+	cls = findClass( cls );
+	if( cls < NumClasses )
 	{
-	  if( prev == 0 )
-	    head = current->m_next;
-	  else
-	    prev->m_next = current->m_next;
-	  
-	  return reinterpret_cast<char*>(&current->m_next);
+	  chunk = reinterpret_cast<char*>( m_buckets[ cls ] );
+	  if( !fits( sizeOf( chunk ), chunkSize ) )
+	  {
+	    // only a class holding chunks large enough to split will do
+	    cls = SizeClasses::classOf( chunkSize + MinChunk );
+	    cls = cls < NumClasses ? findClass( cls ) : NumClasses;
+	    chunk = cls < NumClasses ? reinterpret_cast<char*>( m_buckets[ cls ] ) : 0;
+	  }
+	}
+      }
+      
+      if( !chunk )
+      {
+	// first fit from the oversize list.  it only holds chunks larger
+	// than the last class so stays short relative to the memory it covers.
+	for( _freeEntry * current = m_oversize; current; current = current->m_next )
+	{
+	  if( fits( sizeOf( reinterpret_cast<char*>( current ) ), chunkSize ) )
+	  {
+	    chunk = reinterpret_cast<char*>( current );
+	    break;
+	  }
 	}
+      }
+      
+      if( chunk )
+      {
+#ifdef ARENA_ALLOC_STATS
+	++ base_t::m_recycledHits;
+#endif
+	unlinkFree( chunk );
+	std::size_t size = sizeOf( chunk );
+	head( chunk ) = size | InUse | PrevInUse; // no two free chunks are adjacent
+	if( !SizedDeallocation )
+	  head( chunk + size ) |= PrevInUse; // never the top for the same reason
+	trim( chunk, chunkSize );
+	return chunk;
+      }
+      
+#ifdef ARENA_ALLOC_STATS
+      ++ base_t::m_freshHits;
+#endif
+      return allocateFromTop( chunkSize );
+    }
+    
+    char * allocateFromTop( std::size_t chunkSize )
+    {
+      if( std::size_t( m_topEnd - m_top ) < chunkSize )
+      {
+	// large chunks get a region of their own leaving the top in place
+	if( chunkSize > m_regionSize / 4 )
+	  return allocateRegion( chunkSize );
+	
+	retireTop();
+	m_top = allocateRegion( m_regionSize - 2*HeaderSize );
+	if( !m_top )
+	  return 0;
 	
-	++count;
-	prev = current;
-	current = current->m_next;
+	m_topEnd = m_top + sizeOf( m_top );
       }
       
-      return 0;
+      char * chunk = m_top;
+      head( chunk ) = chunkSize | InUse | PrevInUse;
+      m_top += chunkSize;
+      return chunk;
     }
-
-    void deallocateInternal( char * ptr )
+    
+    // the unused end of the current region becomes an ordinary free chunk
+    void retireTop()
+    {
+      std::size_t remaining = m_topEnd - m_top;
+      if( remaining >= MinChunk )
+      {
+	head( m_top ) = remaining | PrevInUse;
+	if( !SizedDeallocation )
+	{
+	  foot( m_top, remaining ) = remaining;
+	  head( m_topEnd ) &= ~PrevInUse;
+	}
+	insertFree( m_top );
+      }
+      else if( remaining && !SizedDeallocation )
+      {
+	head( m_top ) = remaining | InUse | PrevInUse; // too small to ever be reused
+      }
+      
+      m_top = m_topEnd = 0;
+    }
+    
+    // obtains a region holding a single in use chunk of chunkSize bytes
+    // followed by the fence.
+    char * allocateRegion( std::size_t chunkSize )
+    {
+      std::size_t regionBytes = HeaderSize + chunkSize + HeaderSize;
+      char * region = base_t::allocateFromBlocks( regionBytes, RegionAlignment );
+      if( !region )
+	return 0;
+      
+      base_t::m_numBytesAllocated += regionBytes;
+      
+      char * chunk = region + HeaderSize;
+      head( chunk ) = chunkSize | InUse | PrevInUse;
+      if( !SizedDeallocation )
+	head( chunk + chunkSize ) = InUse | PrevInUse; // fence
+      return chunk;
+    }
+    
+    // splits anything beyond chunkSize off an in use chunk and frees it
+    void trim( char * chunk, std::size_t chunkSize )
     {
-      _freeEntry * v = reinterpret_cast< _freeEntry* >( ptr - sizeof( std::size_t ) );
-      uint16_t bucketNumber = v->m_size / StepSize;
+      std::size_t size = sizeOf( chunk );
+      if( size - chunkSize < MinChunk )
+	return;
       
-      if( bucketNumber > NumBuckets - 1 )
-	bucketNumber = NumBuckets - 1;
+      head( chunk ) = chunkSize | ( head( chunk ) & FlagMask );
+      char * remainder = chunk + chunkSize;
+      head( remainder ) = ( size - chunkSize ) | InUse | PrevInUse;
+      freeChunk( remainder );
+    }
+    
+    void freeChunk( char * chunk )
+    {
+      std::size_t size = sizeOf( chunk );
+      char * next = chunk + size;
+      
+      if( SizedDeallocation )
+      {
+	// neighbours are unknown, only the top can take the chunk back
+	if( next == m_top )
+	  m_top = chunk;
+	else
+	  insertFree( chunk );
+	return;
+      }
+      
+      if( !( head( chunk ) & PrevInUse ) )
+      {
+	std::size_t prevSize = *reinterpret_cast<std::size_t*>( chunk - sizeof( std::size_t ) );
+	chunk -= prevSize;
+	size += prevSize;
+	unlinkFree( chunk );
+      }
+      
+      if( next == m_top )
+      {
+	m_top = chunk; // the top grows back over the chunk
+	return;
+      }
+      
+      if( !( head( next ) & InUse ) )
+      {
+	size += sizeOf( next );
+	unlinkFree( next );
+      }
+      else
+      {
+	head( next ) &= ~PrevInUse;
+      }
       
-      _freeEntry * next = m_buckets[ bucketNumber ];
-      v->m_next = next;
-      m_buckets[ bucketNumber ] = v;
+      head( chunk ) = size | PrevInUse;
+      foot( chunk, size ) = size;
+      insertFree( chunk );
     }
     
   };
   
+  // The recycle arena as first parameterised, NumBuckets size classes
+  // StepSize bytes apart, i.e. _recycleallocimpl< Allocator, 16, 256 >.
+  // _recyclesizeclassimpl takes any size class policy.
+  template< typename AllocatorImpl, uint16_t StepSize = 16, uint16_t NumBuckets = 256,
+	    typename RefCountPolicy = _plainRefCount >
+  using _recycleallocimpl = _recyclesizeclassimpl< AllocatorImpl, _linearSizeClasses<StepSize, NumBuckets>, RefCountPolicy >;
+  
   template< typename T, typename Allocator = _newAllocatorImpl >
   using RecycleAlloc = Alloc< T, Allocator, _recycleallocimpl<Allocator> >;
   
+  // Header free recycling for node based containers.  8 byte size classes
+  // so nodes are packed as densely as their alignment allows.
+  template< typename T, typename Allocator = _newAllocatorImpl >
+  using SizedRecycleAlloc = Alloc< T, Allocator, 
+				   _recyclesizeclassimpl<Allocator, _linearSizeClasses<8, 512>, _plainRefCount, true> >;
+  
 }
 
 #endif
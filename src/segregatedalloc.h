@@ -0,0 +1,265 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  segregatedalloc.h
+ **
+ **  Arena allocator drawing the allocations of each type from runs of
+ **  memory of its own within the arena, so that the nodes of a container
+ **  lie together instead of interleaved with the strings and other
+ **  allocations made alongside them.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _SEGREGATED_ALLOC_H
+#define _SEGREGATED_ALLOC_H
+
+#include "arenaalloc.h"
+
+namespace ArenaAlloc
+{
+
+  // The chain of runs a type allocated through SegregatedAlloc draws
+  // from.  Types of the same size share a chain.  Specialise it, with a
+  // value other than 0, to give a type a chain of its own.
+  template< typename T >
+  struct SegregationKey
+  {
+    static const std::size_t value = sizeof( T );
+  };
+
+  template< typename T, typename A, typename M >
+  class SegregatedAlloc;
+
+  // Runs are carved from the arena's blocks as they are needed and
+  // bump allocated.  Only the cursor of each chain's latest run is kept.
+  struct _segregatedchain
+  {
+    std::size_t m_key; // 0 while the chain is unused
+    char * m_cursor; // 0 until the chain has a run
+    char * m_end;
+  };
+
+  // Arena implementation behind SegregatedAlloc.  The first NumChains
+  // keys allocated get a chain each; further keys, allocations larger
+  // than a quarter of a run and allocations through plain Alloc come
+  // from the blocks as in the basic arena.  A run is a quarter of the
+  // default size.
+  template< typename AllocatorImpl, std::size_t NumChains = 8, typename RefCountPolicy = _plainRefCount >
+  struct _segregatedimpl :
+    public _memblockimplbase<AllocatorImpl, _segregatedimpl<AllocatorImpl, NumChains, RefCountPolicy>,
+			     sizeof( _roundsize ), RefCountPolicy >
+  {
+  private:
+
+    _segregatedchain m_chains[ NumChains ];
+    std::size_t m_runSize;
+
+    typedef struct _memblockimplbase< AllocatorImpl, _segregatedimpl, sizeof( _roundsize ), RefCountPolicy > base_t;
+    friend struct _memblockimplbase< AllocatorImpl, _segregatedimpl, sizeof( _roundsize ), RefCountPolicy >;
+
+    // to get around some sticky access issues between Alloc<T1> and Alloc<T2> when sharing
+    // the implementation.
+    template <typename U, typename A, typename M >
+    friend class Alloc;
+
+    template <typename U, typename A, typename M >
+    friend class SegregatedAlloc;
+
+    template< typename T >
+    static void assign( const Alloc<T,AllocatorImpl, _segregatedimpl >& src,
+			  _segregatedimpl *& dest )
+    {
+      dest = const_cast< _segregatedimpl* >( src.m_impl );
+    }
+
+    static _segregatedimpl * create( std::size_t defaultSize, AllocatorImpl& alloc )
+    {
+      return new (
+	alloc.allocate( sizeof( _segregatedimpl ) ) ) _segregatedimpl( defaultSize, alloc );
+    }
+
+    static void destroy( _segregatedimpl * objToDestroy )
+    {
+      AllocatorImpl allocImpl = objToDestroy->m_alloc;
+      objToDestroy-> ~_segregatedimpl();
+      allocImpl.deallocate( objToDestroy );
+    }
+
+    _segregatedimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
+      base_t( defaultSize, allocImpl ),
+      m_runSize( base_t::m_defaultSize / 4 )
+    {
+      for( std::size_t i = 0; i < NumChains; i++ )
+	m_chains[i].m_key = 0;
+      clearRuns();
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_segregatedimpl=%p constructed with default size=%ld\n", this,
+	       base_t::m_defaultSize );
+#endif
+    }
+
+    ~_segregatedimpl( )
+    {
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "~_segregatedimpl() called on _segregatedimpl=%p\n", this );
+#endif
+      base_t::clear();
+    }
+
+    // runs may lie past the mark so they are abandoned.  the keys keep
+    // their chains so a deallocate takes the path its allocate took.
+    void clearRuns()
+    {
+      for( std::size_t i = 0; i < NumChains; i++ )
+	m_chains[i].m_cursor = m_chains[i].m_end = 0;
+    }
+
+    // the chain for allocations of key, 0 if they come from the blocks
+    _segregatedchain * chainFor( std::size_t key, std::size_t numBytes, std::size_t alignment )
+    {
+      if( numBytes > m_runSize / 4 || numBytes > base_t::m_largeThreshold ||
+	  alignment > _memblock<AllocatorImpl>::BlockAlignment )
+	return 0;
+
+      for( std::size_t i = 0; i < NumChains; i++ )
+      {
+	if( m_chains[i].m_key == key )
+	  return &m_chains[i];
+
+	if( !m_chains[i].m_key )
+	{
+	  m_chains[i].m_key = key;
+	  return &m_chains[i];
+	}
+      }
+      return 0; // every chain is taken
+    }
+
+  public:
+
+    char * allocateFor( std::size_t key, std::size_t numBytes, std::size_t alignment )
+    {
+      _segregatedchain * chain = chainFor( key, numBytes, alignment );
+      if( !chain )
+	return base_t::allocate( numBytes, alignment );
+
+      if( alignment < sizeof( _roundsize ) )
+	alignment = sizeof( _roundsize );
+
+      std::size_t roundedSize = _memblock<AllocatorImpl>::roundSize( numBytes, sizeof( _roundsize ) );
+      char * ptrToReturn = _memblock<AllocatorImpl>::alignPtr( chain->m_cursor, alignment );
+      if( !chain->m_cursor || ptrToReturn > chain->m_end || roundedSize > std::size_t( chain->m_end - ptrToReturn ) )
+      {
+	chain->m_cursor = base_t::allocateFromBlocks( m_runSize, _memblock<AllocatorImpl>::BlockAlignment );
+	chain->m_end = chain->m_cursor + m_runSize;
+	ptrToReturn = _memblock<AllocatorImpl>::alignPtr( chain->m_cursor, alignment );
+
+#ifdef ARENA_ALLOC_DEBUG
+	fprintf( stdout, "_segregatedimpl=%p new run=%p for key=%ld\n", this, chain->m_cursor, key );
+#endif
+      }
+      chain->m_cursor = ptrToReturn + roundedSize;
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_segregatedimpl=%p allocated %ld bytes at address=%p\n", this, numBytes, ptrToReturn );
+#endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceAllocate, this, numBytes, ptrToReturn );
+#endif
+#ifdef ARENA_ALLOC_STATS
+      base_t::recordRequest( numBytes );
+      ++ base_t::m_freshHits;
+#endif
+
+      ++ base_t::m_numAllocate;
+      base_t::m_numBytesAllocated += numBytes;
+      return ptrToReturn;
+    }
+
+    // as in the basic arena the last allocation of a chain is taken back
+    // when it is deallocated with its size.
+    void deallocateFor( std::size_t key, void * ptr, std::size_t numBytes, std::size_t alignment )
+    {
+      _segregatedchain * chain = chainFor( key, numBytes, alignment );
+      if( !chain )
+      {
+	base_t::deallocate( ptr, numBytes );
+	return;
+      }
+
+      base_t::countDeallocation( ptr, numBytes );
+      char * start = reinterpret_cast<char*>( ptr );
+      if( numBytes && start + _memblock<AllocatorImpl>::roundSize( numBytes, sizeof( _roundsize ) ) == chain->m_cursor )
+	chain->m_cursor = start;
+    }
+
+    void rewind( const ArenaMark& mark )
+    {
+      clearRuns();
+      base_t::rewind( mark );
+    }
+
+    void reset( std::size_t maxRetainedBytes )
+    {
+      clearRuns();
+      base_t::reset( maxRetainedBytes );
+    }
+  };
+
+  // Allocator drawing each type from the chain of its SegregationKey in
+  // a _segregatedimpl arena.  Rebinding keeps it segregated, so the
+  // nodes of a map of strings are laid out together while the strings,
+  // allocated through an Alloc sharing the arena, lie elsewhere, i.e.
+  //   typedef ArenaAlloc::Alloc< char, ArenaAlloc::_newAllocatorImpl,
+  //                              ArenaAlloc::_segregatedimpl<ArenaAlloc::_newAllocatorImpl> > charalloc;
+  //   typedef std::basic_string< char, std::char_traits<char>, charalloc > string;
+  //   std::map< int, string, std::less<int>, ArenaAlloc::SegregatedAlloc< std::pair<const int, string> > >
+  //     index( std::less<int>(), ArenaAlloc::SegregatedAlloc<char>( 1024*1024 ) );
+  template< typename T, typename AllocatorImpl = _newAllocatorImpl,
+	    typename MemblockImpl = _segregatedimpl<AllocatorImpl> >
+  class SegregatedAlloc : public Alloc< T, AllocatorImpl, MemblockImpl >
+  {
+    typedef Alloc< T, AllocatorImpl, MemblockImpl > base_t;
+
+  public:
+
+    // rebind allocator to type U
+    template <class U>
+    struct rebind {
+      typedef SegregatedAlloc<U,AllocatorImpl,MemblockImpl> other;
+    };
+
+    SegregatedAlloc( std::size_t defaultSize = 32768, AllocatorImpl allocImpl = AllocatorImpl() ) throw():
+      base_t( defaultSize, allocImpl )
+    {
+    }
+
+    template <class U>
+    SegregatedAlloc( const Alloc<U,AllocatorImpl,MemblockImpl>& src ) throw():
+      base_t( src )
+    {
+    }
+
+    T * allocate( std::size_t num, const void* = 0 )
+    {
+      return reinterpret_cast<T*>( impl()->allocateFor( SegregationKey<T>::value, num*sizeof(T), alignof(T) ) );
+    }
+
+    void deallocate( T * p, std::size_t num )
+    {
+      impl()->deallocateFor( SegregationKey<T>::value, p, num*sizeof(T), alignof(T) );
+    }
+
+  private:
+
+    MemblockImpl * impl() const
+    {
+      MemblockImpl * impl = 0;
+      MemblockImpl::assign( *this, impl );
+      return impl;
+    }
+  };
+
+}
+
+#endif
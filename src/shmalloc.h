@@ -0,0 +1,300 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  shmalloc.h
+ **
+ **  Arena allocator living in a shared memory segment so that several
+ **  local processes can allocate into and read from one arena.  Linux.
+ **  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _SHM_ALLOC_H
+#define _SHM_ALLOC_H
+
+#include "arenaalloc.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // State of the shared arena kept at the start of its segment.  Every
+  // position is an offset from the header so processes mapping the
+  // segment at different addresses agree on it.  Counters are atomics,
+  // which are lock free and address free for these types, so they work
+  // across processes as they do across threads.
+  struct _shmheader
+  {
+    static const uint32_t Magic = 0x41524e41; // "ARNA"
+    static const uint32_t Version = 1;
+
+    enum { Uninitialised = 0, Initialising = 1, Ready = 2 };
+
+    std::atomic<uint32_t> m_state; // zero in a freshly truncated segment
+    uint32_t m_magic;
+    uint32_t m_version;
+    std::size_t m_size; // of the whole segment
+    std::size_t m_dataStart; // offset of the first allocatable byte
+    std::atomic<std::size_t> m_root; // offset of the object published with setRoot, 0 if none
+    alignas( 64 ) std::atomic<std::size_t> m_cursor; // offset of the next allocatable byte.  may overshoot the end
+    std::atomic<std::size_t> m_numAllocate;
+    std::atomic<std::size_t> m_numDeallocate;
+    std::atomic<std::size_t> m_numBytesAllocated;
+
+    static_assert( ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2,
+		   "shared arenas need lock free atomics" );
+
+    char * base() { return reinterpret_cast<char*>( this ); }
+
+    // The first process to map the segment initialises the header, the
+    // others wait until it is done.  The size is checked first so a
+    // failing process never leaves the header half initialised.
+    static _shmheader * attach( char * base, std::size_t size )
+    {
+      if( size < 2 * sizeof( _shmheader ) )
+	throw std::invalid_argument( "Shared memory segment too small" );
+
+      _shmheader * header = reinterpret_cast<_shmheader*>( base );
+      uint32_t state = Uninitialised;
+      if( header->m_state.compare_exchange_strong( state, Initialising, std::memory_order_acquire ) )
+      {
+	header->m_magic = Magic;
+	header->m_version = Version;
+	header->m_size = size;
+	header->m_dataStart = _memblock<_newAllocatorImpl>::roundSize( sizeof( _shmheader ), 64 );
+	header->m_root.store( 0, std::memory_order_relaxed );
+	header->m_cursor.store( header->m_dataStart, std::memory_order_relaxed );
+	header->m_numAllocate.store( 0, std::memory_order_relaxed );
+	header->m_numDeallocate.store( 0, std::memory_order_relaxed );
+	header->m_numBytesAllocated.store( 0, std::memory_order_relaxed );
+	header->m_state.store( Ready, std::memory_order_release );
+      }
+      else
+      {
+	while( header->m_state.load( std::memory_order_acquire ) != Ready )
+	  sched_yield();
+
+	if( header->m_magic != Magic || header->m_version != Version )
+	  throw std::runtime_error( "Shared memory segment does not hold an arena" );
+      }
+
+      return header;
+    }
+  };
+
+  // Mapping of the segment in this process.
+  struct _shmMapping
+  {
+    int m_fd;
+    char * m_base;
+    std::size_t m_size;
+    std::string m_name; // empty for anonymous segments
+
+    _shmMapping( int fd, std::size_t size, const std::string& name ):
+      m_fd( fd ),
+      m_base( 0 ),
+      m_size( size ),
+      m_name( name )
+    {
+      void * addr = mmap( 0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+      if( addr == MAP_FAILED )
+      {
+	close( m_fd );
+	throw std::bad_alloc();
+      }
+
+      m_base = reinterpret_cast<char*>( addr );
+    }
+
+    ~_shmMapping()
+    {
+      munmap( m_base, m_size );
+      close( m_fd );
+    }
+  };
+
+  // Shared memory segment holding an arena, the AllocatorImpl of ShmAlloc.
+  // An anonymous segment is a memfd which children forked after it was
+  // created share, and which other processes may open through
+  // /proc/<pid>/fd or a descriptor passed over a unix socket.  A named
+  // segment is created or opened with shm_open.
+  //
+  // Copies share the mapping, which is unmapped when the last copy in
+  // this process goes.  It must outlive the allocators using it.
+  struct ShmSegment
+  {
+    std::shared_ptr<_shmMapping> m_mapping;
+
+    // anonymous segment of size bytes
+    explicit ShmSegment( std::size_t size )
+    {
+      int fd = memfd_create( "arenaalloc", 0 );
+      if( fd < 0 )
+	throw std::runtime_error( "memfd_create failed" );
+
+      init( fd, size, std::string() );
+    }
+
+    // opens the named segment, creating it with size bytes if it does not
+    // exist.  A size of 0 opens an existing segment at its own size.
+    ShmSegment( const char * name, std::size_t size )
+    {
+      int fd = shm_open( name, O_RDWR | ( size ? O_CREAT : 0 ), 0600 );
+      if( fd < 0 )
+	throw std::runtime_error( std::string( "shm_open failed for " ) + name );
+
+      init( fd, size, name );
+    }
+
+    char * base() const { return m_mapping->m_base; }
+    std::size_t size() const { return m_mapping->m_size; }
+    int fd() const { return m_mapping->m_fd; }
+    _shmheader * header() const { return reinterpret_cast<_shmheader*>( m_mapping->m_base ); }
+
+    // Publishes an object allocated from the segment for other processes
+    // to find.
+    template< typename T >
+    void setRoot( T * obj )
+    {
+      header()->m_root.store( obj ? reinterpret_cast<char*>( obj ) - base() : 0, std::memory_order_release );
+    }
+
+    template< typename T >
+    T * root() const
+    {
+      std::size_t offset = header()->m_root.load( std::memory_order_acquire );
+      return offset ? reinterpret_cast<T*>( base() + offset ) : 0;
+    }
+
+    // removes the name of a named segment, mappings stay valid
+    void unlink()
+    {
+      if( !m_mapping->m_name.empty() )
+	shm_unlink( m_mapping->m_name.c_str() );
+    }
+
+  private:
+
+    void init( int fd, std::size_t size, const std::string& name )
+    {
+      struct stat st;
+      if( fstat( fd, &st ) != 0 || ( std::size_t( st.st_size ) < size && ftruncate( fd, size ) != 0 ) )
+      {
+	close( fd );
+	throw std::runtime_error( "Unable to size shared memory segment" );
+      }
+
+      m_mapping = std::make_shared<_shmMapping>( fd, size > std::size_t( st.st_size ) ? size : st.st_size, name );
+      _shmheader::attach( m_mapping->m_base, m_mapping->m_size );
+    }
+  };
+
+  // Arena in a shared memory segment.  The implementation object is the
+  // segment's header so every allocator using the segment, in any
+  // process, shares the one arena.  Allocation is a lock free fetch_add
+  // on the cursor in the header, as in _concurrentmemblockimpl, and may be
+  // made from any thread of any process.  The arena is bounded by the
+  // segment, std::bad_alloc is thrown once it is full.  Memory is only
+  // reclaimed by discarding the segment.
+  //
+  // The segment is one block of fixed size rather than a chain of blocks
+  // like the other arenas.  A further segment could not be mapped at the
+  // same address in every process, which the containers of forked
+  // children rely on, so the segment is sized for what it must hold.
+  //
+  // The arena lives as long as the segment so there is no reference
+  // count, which could not be kept across fork() anyway.  The default
+  // size passed to the allocator is unused.
+  //
+  // Containers built in the segment hold raw pointers unless they use
+  // OffsetAlloc from offsetptr.h.  They are usable as they are by forked
+  // children, which see the segment at the parent's address.  Processes
+  // mapping it elsewhere may allocate from it but can only read
+  // containers built with offset pointers.
+  template< typename AllocatorImpl = ShmSegment, std::size_t Alignment = sizeof( _roundsize ) >
+  struct _shmmemblockimpl : public _shmheader
+  {
+  private:
+
+    static_assert( Alignment && !( Alignment & ( Alignment - 1 ) ), "Alignment must be a power of 2" );
+
+    template <typename U, typename A, typename M >
+    friend class Alloc;
+
+    template< typename T >
+    static void assign( const Alloc<T,AllocatorImpl, _shmmemblockimpl >& src,
+			_shmmemblockimpl *& dest )
+    {
+      dest = const_cast< _shmmemblockimpl* >( src.m_impl );
+    }
+
+    static _shmmemblockimpl * create( std::size_t, AllocatorImpl& segment )
+    {
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_shmmemblockimpl=%p attached to a segment of size=%ld\n", segment.header(),
+	       segment.size() );
+#endif
+      return static_cast<_shmmemblockimpl*>( segment.header() );
+    }
+
+    static void destroy( _shmmemblockimpl * )
+    {
+    }
+
+  public:
+
+    char * allocate( std::size_t numBytes, std::size_t alignment = Alignment )
+    {
+      if( alignment < Alignment )
+	alignment = Alignment;
+
+      // every reservation is a multiple of Alignment so only stricter
+      // alignments need padding.
+      std::size_t reserve = _memblock<AllocatorImpl>::roundSize( numBytes, Alignment );
+      if( alignment > Alignment )
+	reserve += alignment - Alignment;
+
+      std::size_t start = m_cursor.fetch_add( reserve, std::memory_order_relaxed );
+      if( start > m_size || reserve > m_size - start )
+	throw std::bad_alloc();
+
+      m_numAllocate.fetch_add( 1, std::memory_order_relaxed );
+      m_numBytesAllocated.fetch_add( numBytes, std::memory_order_relaxed );
+
+      char * ptrToReturn = _memblock<AllocatorImpl>::alignPtr( base() + start, alignment );
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_shmmemblockimpl=%p allocated %ld bytes at address=%p\n", this, numBytes, ptrToReturn );
+#endif
+      return ptrToReturn;
+    }
+
+    void deallocate( void *, std::size_t = 0, std::size_t = Alignment )
+    {
+      m_numDeallocate.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    std::size_t getNumAllocations() { return m_numAllocate.load( std::memory_order_relaxed ); }
+    std::size_t getNumDeallocations() { return m_numDeallocate.load( std::memory_order_relaxed ); }
+    std::size_t getNumBytesAllocated() { return m_numBytesAllocated.load( std::memory_order_relaxed ); }
+
+    void incrementRefCount() {}
+    void decrementRefCount() {}
+  };
+
+  // Arena allocator over a shared memory segment, i.e.
+  //   ArenaAlloc::ShmSegment segment( 1024*1024*1024 );
+  //   ArenaAlloc::ShmAlloc<int> alloc( 0, segment );
+  template< typename T >
+  using ShmAlloc = Alloc< T, ShmSegment, _shmmemblockimpl<ShmSegment> >;
+
+}
+
+#endif
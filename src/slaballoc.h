@@ -0,0 +1,389 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  slaballoc.h
+ **
+ **  Arena allocator recycling freed resources in fixed size slabs.  Suited
+ **  to node based containers which allocate one identically sized node at
+ **  a time.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _SLAB_ALLOC_H
+#define _SLAB_ALLOC_H
+
+#include "arenaalloc.h"
+#include <string.h>
+#include <inttypes.h>
+
+namespace ArenaAlloc
+{
+
+  // Header at the start of every slab page.  Slots are carved lazily from
+  // the front of the page so a fresh slab costs nothing until it is used.
+  struct _slab
+  {
+    _slab * m_next; // partial slabs of the same size or the free page list
+    _slab * m_prev;
+    char * m_free; // intrusive list of freed slots
+    uint32_t m_slotSize;
+    uint32_t m_firstSlot; // offset of slot 0 from the page
+    uint32_t m_capacity;
+    uint32_t m_carved; // slots handed out at least once
+    uint32_t m_inUse;
+    uint32_t m_serial; // order in which pages were taken from the blocks
+  };
+
+  // Requests of up to MaxSlotSize bytes are rounded to a multiple of 8
+  // and served from slabs of that slot size, one per PageSize page.  The
+  // rebound allocators of a container share one impl and so each node
+  // type gets a slab size of its own.  The page owning a slot is found by
+  // masking its address so nothing is stored per slot.
+  //
+  // Slabs with free slots are kept on a list per slot size, allocation
+  // takes from the first.  A slab whose last slot is freed gives its page
+  // to a free page list, for reuse by any slot size, unless it is the only
+  // slab of its size with free slots.  Larger requests are bump allocated
+  // from the arena and not recycled, or given memory of their own above
+  // the arena's large threshold.
+  //
+  // Slots are aligned to the largest power of 2 dividing their size which
+  // covers the alignment of any T allocated through Alloc<T>.  Requests
+  // needing more, i.e. 24 bytes 16 byte aligned through allocateBytes or a
+  // memory_resource, are bump allocated from the arena like larger ones.
+  // The size of the allocation, and any such alignment, must be passed to
+  // deallocate.
+  //
+  // A mark seals the slabs existing when it is taken, allocations made
+  // after it come from slabs of their own and a rewind drops those and
+  // unseals the rest.  Slots freed in sealed slabs are reused after the
+  // rewind.
+  template< typename AllocatorImpl, std::size_t PageSize = 8192, std::size_t MaxSlotSize = 512,
+	    typename RefCountPolicy = _plainRefCount >
+  struct _slaballocimpl :
+    public _memblockimplbase<AllocatorImpl, _slaballocimpl<AllocatorImpl, PageSize, MaxSlotSize, RefCountPolicy>,
+			     sizeof( _roundsize ), RefCountPolicy >
+  {
+  private:
+
+    static const std::size_t Granularity = 8; // slot sizes are a multiple of this
+    static const std::size_t NumClasses = MaxSlotSize / Granularity;
+
+    static_assert( PageSize && !( PageSize & ( PageSize - 1 ) ), "Page size must be a power of 2" );
+    static_assert( MaxSlotSize >= Granularity && MaxSlotSize % Granularity == 0,
+		   "Max slot size must be a multiple of 8" );
+    static_assert( PageSize >= 2 * MaxSlotSize + sizeof( _slab ), "Page size too small for the largest slot" );
+
+    _slab * m_partial[ NumClasses ]; // slabs with a free or uncarved slot
+    _slab * m_freePages; // empty pages available to any slot size
+    _slab * m_sealed; // slabs with a free or uncarved slot sealed by a mark
+    std::size_t m_numSlabs; // pages taken from the blocks
+    std::size_t m_sealedSlabs; // slabs with a lower serial are sealed
+
+    typedef struct _memblockimplbase< AllocatorImpl, _slaballocimpl, sizeof( _roundsize ), RefCountPolicy > base_t;
+    friend struct _memblockimplbase< AllocatorImpl, _slaballocimpl, sizeof( _roundsize ), RefCountPolicy >;
+
+    // to get around some sticky access issues between Alloc<T1> and Alloc<T2> when sharing
+    // the implementation.
+    template <typename U, typename A, typename M >
+    friend class Alloc;
+
+    template< typename T >
+    static void assign( const Alloc<T,AllocatorImpl, _slaballocimpl >& src,
+			  _slaballocimpl *& dest )
+    {
+      dest = const_cast< _slaballocimpl* >( src.m_impl );
+    }
+
+    static _slaballocimpl * create( std::size_t defaultSize, AllocatorImpl& alloc )
+    {
+      return new (
+	alloc.allocate( sizeof( _slaballocimpl ) ) ) _slaballocimpl( defaultSize, alloc );
+    }
+
+    static void destroy( _slaballocimpl * objToDestroy )
+    {
+      AllocatorImpl allocImpl = objToDestroy->m_alloc;
+      objToDestroy-> ~_slaballocimpl();
+      allocImpl.deallocate( objToDestroy );
+    }
+
+    _slaballocimpl( std::size_t defaultSize, AllocatorImpl& allocImpl ):
+      base_t( defaultSize < 2 * PageSize ? 2 * PageSize : defaultSize, allocImpl )
+    {
+      clearSlabs();
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_slaballocimpl=%p constructed with default size=%ld\n", this,
+	       base_t::m_defaultSize );
+#endif
+    }
+
+    ~_slaballocimpl( )
+    {
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "~_slaballocimpl() called on _slaballocimpl=%p\n", this );
+#endif
+      base_t::clear();
+    }
+
+    void clearSlabs()
+    {
+      memset( m_partial, 0, sizeof( m_partial ) );
+      m_freePages = m_sealed = 0;
+      m_numSlabs = m_sealedSlabs = 0;
+    }
+
+    static std::size_t classOf( std::size_t numBytes )
+    {
+      return numBytes ? ( numBytes - 1 ) / Granularity : 0;
+    }
+
+    // whether a request is served from the blocks rather than a slot
+    static bool inBlocks( std::size_t numBytes, std::size_t alignment )
+    {
+      return numBytes > MaxSlotSize || alignment > slotAlignment( classOf( numBytes ) );
+    }
+
+    static std::size_t slotAlignment( std::size_t cls )
+    {
+      std::size_t slotSize = ( cls + 1 ) * Granularity;
+      return slotSize & ( ~slotSize + 1 ); // lowest set bit
+    }
+
+    // blocks start on a page boundary so they divide into whole pages
+    static std::size_t blockAlignment()
+    {
+      return PageSize;
+    }
+
+  public:
+
+    char * allocate( std::size_t numBytes, std::size_t alignment = sizeof( std::size_t ) )
+    {
+      if( inBlocks( numBytes, alignment ) )
+	return base_t::allocate( numBytes, alignment );
+
+      std::size_t cls = classOf( numBytes );
+      _slab * slab = m_partial[ cls ];
+      if( !slab )
+      {
+	slab = newSlab( cls );
+	if( !slab )
+	  return 0; // allocation failure
+      }
+
+      char * slot = slab->m_free;
+      if( slot )
+      {
+	slab->m_free = *reinterpret_cast<char**>( slot );
+#ifdef ARENA_ALLOC_STATS
+	++ base_t::m_recycledHits;
+#endif
+      }
+      else
+      {
+	slot = reinterpret_cast<char*>( slab ) + slab->m_firstSlot + slab->m_carved++ * slab->m_slotSize;
+#ifdef ARENA_ALLOC_STATS
+	++ base_t::m_freshHits;
+#endif
+      }
+
+#ifdef ARENA_ALLOC_STATS
+      base_t::recordRequest( numBytes );
+#endif
+#ifdef ARENA_ALLOC_TRACE
+      ArenaTrace::record( TraceAllocate, this, numBytes, slot );
+#endif
+
+      if( ++ slab->m_inUse == slab->m_capacity )
+	unlink( slab, cls ); // full slabs are off the list until a slot is freed
+
+      ++ base_t::m_numAllocate;
+      return slot;
+    }
+
+    void deallocate( void * ptr, std::size_t numBytes, std::size_t alignment = sizeof( std::size_t ) )
+    {
+      if( inBlocks( numBytes, alignment ) )
+      {
+	base_t::deallocate( ptr, numBytes ); // gives back a large allocation
+	return;
+      }
+
+      base_t::countDeallocation( ptr, numBytes );
+
+      _slab * slab = reinterpret_cast<_slab*>( reinterpret_cast<uintptr_t>( ptr ) & ~uintptr_t( PageSize - 1 ) );
+      std::size_t cls = classOf( slab->m_slotSize );
+
+      *reinterpret_cast<char**>( ptr ) = slab->m_free;
+      slab->m_free = reinterpret_cast<char*>( ptr );
+
+      if( slab->m_serial < m_sealedSlabs )
+      {
+	// kept for after the rewind
+	if( slab->m_inUse-- == slab->m_capacity )
+	{
+	  slab->m_next = m_sealed;
+	  m_sealed = slab;
+	}
+	return;
+      }
+
+      if( slab->m_inUse-- == slab->m_capacity )
+	pushFront( slab, cls );
+
+      if( !slab->m_inUse && ( slab->m_prev || slab->m_next ) )
+      {
+	// the page can go to any slot size.  the last slab of a size is
+	// kept so alternating allocate and free do not churn pages.
+	unlink( slab, cls );
+	slab->m_next = m_freePages;
+	m_freePages = slab;
+      }
+    }
+
+    // slots have a fixed size, only larger allocations come from the
+    // blocks and may change size in place.
+    bool tryExpand( void * ptr, std::size_t oldBytes, std::size_t newBytes )
+    {
+      return oldBytes > MaxSlotSize && newBytes > MaxSlotSize && base_t::tryExpand( ptr, oldBytes, newBytes );
+    }
+
+    // seals the slabs with free slots and the free pages.  Full slabs
+    // are sealed by their serial and join them when a slot is freed.
+    ArenaMark mark()
+    {
+      ArenaMark mark = base_t::mark();
+      mark.m_numSlabs = m_numSlabs;
+      mark.m_sealedSlabs = m_sealedSlabs;
+
+      for( std::size_t cls = 0; cls <= NumClasses; cls++ )
+      {
+	_slab * slabs = cls < NumClasses ? m_partial[ cls ] : m_freePages;
+	while( slabs )
+	{
+	  _slab * next = slabs->m_next;
+	  slabs->m_next = m_sealed;
+	  m_sealed = slabs;
+	  slabs = next;
+	}
+      }
+
+      memset( m_partial, 0, sizeof( m_partial ) );
+      m_freePages = 0;
+      m_sealedSlabs = m_numSlabs;
+      return mark;
+    }
+
+    // the slabs on the lists all came after the mark and are dropped
+    // with their pages.  Sealed slabs taken before the mark are unsealed,
+    // those sealed by an enclosing mark stay sealed.  Full slabs are on
+    // no list so the slabs dropped can never be reached from those kept.
+    void rewind( const ArenaMark& mark )
+    {
+      if( !base_t::validMark( mark ) )
+	return;
+
+      _slab * slabs = m_sealed;
+      clearSlabs();
+      while( slabs )
+      {
+	_slab * next = slabs->m_next;
+	if( slabs->m_serial < mark.m_sealedSlabs )
+	{
+	  slabs->m_next = m_sealed;
+	  m_sealed = slabs;
+	}
+	else if( slabs->m_serial < mark.m_numSlabs )
+	{
+	  if( slabs->m_inUse )
+	  {
+	    pushFront( slabs, classOf( slabs->m_slotSize ) );
+	  }
+	  else
+	  {
+	    slabs->m_next = m_freePages;
+	    m_freePages = slabs;
+	  }
+	}
+	slabs = next;
+      }
+
+      m_numSlabs = mark.m_numSlabs;
+      m_sealedSlabs = mark.m_sealedSlabs;
+      base_t::rewind( mark );
+    }
+
+    // nothing survives a reset so the slab lists are simply dropped
+    void reset( std::size_t maxRetainedBytes )
+    {
+      clearSlabs();
+      base_t::reset( maxRetainedBytes );
+    }
+
+  private:
+
+    _slab * newSlab( std::size_t cls )
+    {
+      char * page = reinterpret_cast<char*>( m_freePages );
+      if( page )
+      {
+	m_freePages = m_freePages->m_next;
+      }
+      else
+      {
+	page = base_t::allocateFromBlocks( PageSize, PageSize );
+	if( !page )
+	  return 0;
+
+	base_t::m_numBytesAllocated += PageSize;
+	reinterpret_cast<_slab*>( page )->m_serial = m_numSlabs++;
+      }
+
+      std::size_t slotSize = ( cls + 1 ) * Granularity;
+
+      _slab * slab = reinterpret_cast<_slab*>( page );
+      slab->m_free = 0;
+      slab->m_slotSize = slotSize;
+      slab->m_firstSlot = _memblock<AllocatorImpl>::roundSize( sizeof( _slab ), slotAlignment( cls ) );
+      slab->m_capacity = ( PageSize - slab->m_firstSlot ) / slotSize;
+      slab->m_carved = 0;
+      slab->m_inUse = 0;
+      pushFront( slab, cls );
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "_slaballocimpl=%p new slab=%p of slot size=%ld\n", this, slab, slotSize );
+#endif
+      return slab;
+    }
+
+    void pushFront( _slab * slab, std::size_t cls )
+    {
+      slab->m_prev = 0;
+      slab->m_next = m_partial[ cls ];
+      if( slab->m_next )
+	slab->m_next->m_prev = slab;
+      m_partial[ cls ] = slab;
+    }
+
+    void unlink( _slab * slab, std::size_t cls )
+    {
+      if( slab->m_next )
+	slab->m_next->m_prev = slab->m_prev;
+
+      if( slab->m_prev )
+	slab->m_prev->m_next = slab->m_next;
+      else
+	m_partial[ cls ] = slab->m_next;
+
+      slab->m_next = slab->m_prev = 0;
+    }
+
+  };
+
+  template< typename T, typename Allocator = _newAllocatorImpl >
+  using SlabAlloc = Alloc< T, Allocator, _slaballocimpl<Allocator> >;
+
+}
+
+#endif
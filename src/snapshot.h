@@ -0,0 +1,277 @@
+// -*- c++ -*-
+/******************************************************************************
+ **  snapshot.h
+ **
+ **  Saving arenas to a file and mapping them back at their original
+ **  address, so that the containers in them are usable at once on a
+ **  warm start with no deserialisation.  Linux.  Requires c++11.
+ **  MIT license
+ **
+ *****************************************************************************/
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include "arenaalloc.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <typeinfo>
+#include <stdexcept>
+#include <new>
+
+namespace ArenaAlloc
+{
+
+  // First page of a snapshot region and of its file.
+  struct _snapshotheader
+  {
+    static const uint64_t Magic = 0x544f4e5350414e41ULL; // "ANAPSNOT"
+
+    uint64_t m_magic;
+    uint64_t m_fingerprint; // of the build and root type which saved it
+    uintptr_t m_base; // address the region must be mapped at
+    std::size_t m_reserveSize;
+    std::size_t m_pageSize;
+    std::size_t m_root; // offset of the root object, 0 if none
+    std::atomic<std::size_t> m_used; // bytes handed out including this page.  may overshoot the end
+  };
+
+  // Layout fingerprint of a snapshot whose root object is of type Root.
+  // It covers the compiler, the standard library, the pointer size and
+  // the size, alignment and name of Root, so a snapshot is refused by a
+  // build which may lay its containers out differently.  Bump version
+  // when the types reachable from Root change.
+  template< typename Root >
+  uint64_t snapshotFingerprint( uint32_t version = 0 )
+  {
+    std::string layout( "arenaalloc snapshot 1 " );
+#ifdef __VERSION__
+    layout += __VERSION__;
+#endif
+#if defined( __GLIBCXX__ )
+    layout += " libstdc++ " + std::to_string( __GLIBCXX__ );
+#elif defined( _LIBCPP_VERSION )
+    layout += " libc++ " + std::to_string( _LIBCPP_VERSION );
+#endif
+    layout += " " + std::to_string( sizeof( void* ) ) + " " + std::to_string( sizeof( Root ) ) + " " +
+      std::to_string( alignof( Root ) ) + " " + typeid( Root ).name() + " " + std::to_string( version );
+
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for( std::size_t i = 0; i < layout.size(); i++ )
+      hash = ( hash ^ static_cast<unsigned char>( layout[i] ) ) * 0x100000001b3ULL;
+
+    return hash;
+  }
+
+  // AllocatorImpl bump allocating every allocation of an arena, blocks
+  // and bookkeeping alike, from a SnapshotRegion.  deallocate is a no-op,
+  // the space is recovered with the region.  Thread safe.
+  struct SnapshotAllocatorImpl
+  {
+    _snapshotheader * m_region;
+
+    void* allocate( size_t numBytes )
+    {
+      std::size_t reserve = _memblock<SnapshotAllocatorImpl>::roundSize( numBytes, 64 );
+      std::size_t start = m_region->m_used.fetch_add( reserve, std::memory_order_relaxed );
+      if( start > m_region->m_reserveSize || reserve > m_region->m_reserveSize - start )
+	throw std::bad_alloc();
+
+      return reinterpret_cast<char*>( m_region ) + start;
+    }
+
+    void deallocate( void* ) {}
+  };
+
+  // Address space reserved at a fixed address holding arenas which can be
+  // saved to a file and restored at that address in a later process.
+  // Arenas using region.allocatorImpl() keep their blocks and their own
+  // bookkeeping in the region, so the containers in them, and the
+  // allocators inside those containers, stay valid when it is restored.
+  // A restored region may be allocated from further, its pages are copy
+  // on write mappings of the file.
+  //
+  // Objects in the region must not point outside it.  Strings short
+  // enough for the small string optimisation are fine, pointers to
+  // static data, virtual functions and the heap are not.  The address
+  // must be free in every process using the snapshot, the default lies
+  // well away from where Linux places mappings and the heap.
+  //
+  // i.e.
+  //   ArenaAlloc::SnapshotRegion region( 1UL << 36 );
+  //   ArenaAlloc::Alloc<char, ArenaAlloc::SnapshotAllocatorImpl> alloc( 1 << 20, region.allocatorImpl() );
+  //   ... build a map from alloc, placed in memory from alloc ...
+  //   region.setRoot( map );
+  //   region.save( path, ArenaAlloc::snapshotFingerprint<maptype>() );
+  // and on the warm start
+  //   ArenaAlloc::SnapshotRegion region( path, ArenaAlloc::snapshotFingerprint<maptype>() );
+  //   maptype * map = region.root<maptype>();
+  class SnapshotRegion
+  {
+    _snapshotheader * m_header;
+
+    SnapshotRegion( const SnapshotRegion& );
+    SnapshotRegion& operator = ( const SnapshotRegion& );
+
+  public:
+
+    static const uintptr_t DefaultBase = 0x200000000000ULL;
+
+    // reserves reserveBytes of address space at base
+    explicit SnapshotRegion( std::size_t reserveBytes, uintptr_t base = DefaultBase ):
+      m_header( 0 )
+    {
+      std::size_t pageSize = sysconf( _SC_PAGESIZE );
+      reserveBytes = _memblock<SnapshotAllocatorImpl>::roundSize( reserveBytes, pageSize );
+      m_header = reinterpret_cast<_snapshotheader*>( reserve( base, reserveBytes ) );
+
+      new ( m_header ) _snapshotheader();
+      m_header->m_magic = _snapshotheader::Magic;
+      m_header->m_fingerprint = 0;
+      m_header->m_base = base;
+      m_header->m_reserveSize = reserveBytes;
+      m_header->m_pageSize = pageSize;
+      m_header->m_root = 0;
+      m_header->m_used.store( pageSize, std::memory_order_relaxed );
+    }
+
+    // Restores the region saved in the file at path at the address it
+    // was saved from.  Throws std::runtime_error if the file was saved
+    // with another fingerprint or the address is taken.  Pages are read
+    // from the file as they are touched.
+    SnapshotRegion( const char * path, uint64_t fingerprint ):
+      m_header( 0 )
+    {
+      int fd = open( path, O_RDONLY );
+      if( fd < 0 )
+	throw std::runtime_error( std::string( "Unable to open snapshot " ) + path );
+
+      _snapshotheader saved;
+      if( pread( fd, &saved, sizeof( saved ), 0 ) != sizeof( saved ) ||
+	  saved.m_magic != _snapshotheader::Magic )
+      {
+	close( fd );
+	throw std::runtime_error( std::string( "Not an arena snapshot " ) + path );
+      }
+
+      if( saved.m_fingerprint != fingerprint || saved.m_pageSize != std::size_t( sysconf( _SC_PAGESIZE ) ) )
+      {
+	close( fd );
+	throw std::runtime_error( std::string( "Snapshot saved by an incompatible build " ) + path );
+      }
+
+      std::size_t fileSize = lseek( fd, 0, SEEK_END );
+      if( fileSize > saved.m_reserveSize )
+	fileSize = saved.m_reserveSize;
+
+      try
+      {
+	m_header = reinterpret_cast<_snapshotheader*>( reserve( saved.m_base, saved.m_reserveSize ) );
+      }
+      catch( ... )
+      {
+	close( fd );
+	throw;
+      }
+
+      // replaces the start of the reservation just made
+      void * addr = mmap( m_header, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 );
+      close( fd );
+      if( addr == MAP_FAILED )
+      {
+	munmap( m_header, saved.m_reserveSize );
+	throw std::runtime_error( std::string( "Unable to map snapshot " ) + path );
+      }
+
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "SnapshotRegion=%p restored %ld bytes from %s\n", m_header, fileSize, path );
+#endif
+    }
+
+    ~SnapshotRegion()
+    {
+      munmap( m_header, m_header->m_reserveSize );
+    }
+
+    SnapshotAllocatorImpl allocatorImpl() const
+    {
+      SnapshotAllocatorImpl impl = { m_header };
+      return impl;
+    }
+
+    char * base() const { return reinterpret_cast<char*>( m_header ); }
+    std::size_t used() const
+    {
+      std::size_t used = m_header->m_used.load( std::memory_order_relaxed );
+      return used < m_header->m_reserveSize ? used : m_header->m_reserveSize;
+    }
+
+    template< typename T >
+    void setRoot( T * obj )
+    {
+      m_header->m_root = obj ? reinterpret_cast<char*>( obj ) - base() : 0;
+    }
+
+    template< typename T >
+    T * root() const
+    {
+      return m_header->m_root ? reinterpret_cast<T*>( base() + m_header->m_root ) : 0;
+    }
+
+    // Writes the used part of the region to path.  Nothing may allocate
+    // from the region or modify what is in it meanwhile.
+    void save( const char * path, uint64_t fingerprint )
+    {
+      m_header->m_fingerprint = fingerprint;
+      std::size_t fileSize = _memblock<SnapshotAllocatorImpl>::roundSize( used(), m_header->m_pageSize );
+
+      int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      if( fd < 0 )
+	throw std::runtime_error( std::string( "Unable to create snapshot " ) + path );
+
+      for( std::size_t offset = 0; offset < fileSize; )
+      {
+	ssize_t written = write( fd, base() + offset, fileSize - offset );
+	if( written <= 0 )
+	{
+	  close( fd );
+	  throw std::runtime_error( std::string( "Unable to write snapshot " ) + path );
+	}
+	offset += written;
+      }
+
+      close( fd );
+#ifdef ARENA_ALLOC_DEBUG
+      fprintf( stdout, "SnapshotRegion=%p saved %ld bytes to %s\n", m_header, fileSize, path );
+#endif
+    }
+
+  private:
+
+    static char * reserve( uintptr_t base, std::size_t numBytes )
+    {
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#ifdef MAP_FIXED_NOREPLACE
+      flags |= MAP_FIXED_NOREPLACE;
+#endif
+      void * addr = mmap( reinterpret_cast<void*>( base ), numBytes, PROT_READ | PROT_WRITE, flags, -1, 0 );
+      if( addr != MAP_FAILED && addr != reinterpret_cast<void*>( base ) )
+      {
+	// kernels before 4.17 take MAP_FIXED_NOREPLACE as a hint
+	munmap( addr, numBytes );
+	addr = MAP_FAILED;
+      }
+
+      if( addr == MAP_FAILED )
+	throw std::runtime_error( "Snapshot region address is in use" );
+
+      return reinterpret_cast<char*>( addr );
+    }
+  };
+
+}
+
+#endif
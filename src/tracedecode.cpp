@@ -0,0 +1,221 @@
+/*******************************************************************************
+ * tracedecode.cpp
+ * Decoder for the trace files written by ArenaAlloc::ArenaTrace::write()
+ * when the arenas are compiled with ARENA_ALLOC_TRACE (see arenatrace.h).
+ * The events of all threads are merged in timestamp order and, for every
+ * arena, the allocations are matched with their deallocations to give:
+ *   allocation and block counts, bytes requested, peak and final live bytes
+ *   a log2 histogram of allocation lifetimes in nanoseconds
+ * With --timeline every event is printed as well.
+ *
+ * Allocations still live when their arena is reset or destroyed end
+ * there.  A rewind does not end them, they show as live until then.
+ *
+ * MIT license
+ *****************************************************************************/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string.h>
+#include "arenatrace.h"
+
+// compile as: g++ -O2 -std=c++11 -o tracedecode tracedecode.cpp
+// run as: ./tracedecode [--timeline] tracefile
+
+using namespace ArenaAlloc;
+
+static const char * opName( uint16_t op )
+{
+  static const char * names[] = { "?", "create", "destroy", "allocate", "deallocate", "newblock",
+				  "releaseblock", "rewind", "reset", "ref+", "ref-" };
+  return op < sizeof( names ) / sizeof( names[0] ) ? names[op] : "?";
+}
+
+struct liveAllocation
+{
+  uint64_t m_tsc;
+  uint64_t m_size;
+};
+
+struct arenaRecord
+{
+  uint64_t m_address;
+  uint64_t m_created; // timestamps, 0 if not in the trace
+  uint64_t m_destroyed;
+  uint64_t m_numAllocations;
+  uint64_t m_numDeallocations;
+  uint64_t m_numBlocks;
+  uint64_t m_bytesRequested;
+  uint64_t m_blockBytes;
+  uint64_t m_liveBytes;
+  uint64_t m_peakLiveBytes;
+  uint64_t m_endedByArena; // allocations ended by reset or destroy
+  uint64_t m_lifetimes[64]; // log2 of the lifetime in ns
+  std::map< uint64_t, liveAllocation > m_live; // by address
+
+  explicit arenaRecord( uint64_t address ):
+    m_address( address ), m_created( 0 ), m_destroyed( 0 ), m_numAllocations( 0 ), m_numDeallocations( 0 ),
+    m_numBlocks( 0 ), m_bytesRequested( 0 ), m_blockBytes( 0 ), m_liveBytes( 0 ), m_peakLiveBytes( 0 ),
+    m_endedByArena( 0 )
+  {
+    memset( m_lifetimes, 0, sizeof( m_lifetimes ) );
+  }
+
+  void end( uint64_t tsc, uint64_t startTsc, double ticksPerNs )
+  {
+    uint64_t ns = uint64_t( ( tsc > startTsc ? tsc - startTsc : 0 ) / ticksPerNs );
+    ++ m_lifetimes[ ns ? 63 - __builtin_clzll( ns ) : 0 ];
+  }
+
+  void endAll( uint64_t tsc, double ticksPerNs )
+  {
+    for( std::map< uint64_t, liveAllocation >::iterator itr = m_live.begin(); itr != m_live.end(); ++itr )
+      end( tsc, itr->second.m_tsc, ticksPerNs );
+
+    m_endedByArena += m_live.size();
+    m_live.clear();
+    m_liveBytes = 0;
+  }
+};
+
+static bool byTimestamp( const TraceEvent& a, const TraceEvent& b )
+{
+  return a.m_tsc < b.m_tsc;
+}
+
+int main( int argc, char ** argv )
+{
+  bool timeline = argc > 2 && strcmp( argv[1], "--timeline" ) == 0;
+  if( argc < 2 || ( argc > 2 && !timeline ) )
+  {
+    std::cerr << "usage: " << argv[0] << " [--timeline] tracefile" << std::endl;
+    return 1;
+  }
+
+  std::ifstream in( argv[ argc - 1 ], std::ios::binary );
+  TraceFileHeader header;
+  if( !in.read( reinterpret_cast<char*>( &header ), sizeof( header ) ) ||
+      header.m_magic != TraceFileHeader::Magic || header.m_eventSize != sizeof( TraceEvent ) )
+  {
+    std::cerr << argv[ argc - 1 ] << " is not an arena trace" << std::endl;
+    return 1;
+  }
+
+  std::vector<TraceEvent> events;
+  uint64_t dropped = 0;
+  for( uint32_t i = 0; i < header.m_numRings; i++ )
+  {
+    TraceRingHeader ring;
+    if( !in.read( reinterpret_cast<char*>( &ring ), sizeof( ring ) ) )
+      break;
+
+    std::size_t first = events.size();
+    events.resize( first + ring.m_numEvents );
+    if( ring.m_numEvents && !in.read( reinterpret_cast<char*>( &events[ first ] ), ring.m_numEvents * sizeof( TraceEvent ) ) )
+    {
+      std::cerr << "truncated trace" << std::endl;
+      return 1;
+    }
+    dropped += ring.m_numDropped;
+  }
+
+  std::stable_sort( events.begin(), events.end(), byTimestamp );
+  if( events.empty() )
+  {
+    std::cout << "no events" << std::endl;
+    return 0;
+  }
+
+  double ticksPerNs = header.m_ticksPerNs > 0 ? header.m_ticksPerNs : 1.0;
+  uint64_t origin = events.front().m_tsc;
+  std::cout << events.size() << " events from " << header.m_numRings << " threads over "
+	    << ( events.back().m_tsc - origin ) / ticksPerNs / 1e6 << " ms, " << dropped
+	    << " older events overwritten" << std::endl;
+
+  // arenas by address.  an address reused after a destroy starts a new record.
+  std::vector<arenaRecord> arenas;
+  std::map< uint64_t, std::size_t > current;
+  for( std::size_t i = 0; i < events.size(); i++ )
+  {
+    const TraceEvent& event = events[i];
+    if( timeline )
+      std::cout << std::fixed << std::setprecision( 0 ) << ( event.m_tsc - origin ) / ticksPerNs << " ns thread "
+		<< event.m_thread << " arena 0x" << std::hex << event.m_arena << " " << opName( event.m_op )
+		<< " size " << std::dec << event.m_size << " address 0x" << std::hex << event.m_address
+		<< std::dec << std::endl;
+
+    std::map< uint64_t, std::size_t >::iterator itr = current.find( event.m_arena );
+    if( itr == current.end() || event.m_op == TraceCreate )
+    {
+      arenas.push_back( arenaRecord( event.m_arena ) );
+      itr = current.insert( std::make_pair( event.m_arena, arenas.size() - 1 ) ).first;
+      itr->second = arenas.size() - 1;
+    }
+
+    arenaRecord& arena = arenas[ itr->second ];
+    switch( event.m_op )
+    {
+    case TraceCreate:
+      arena.m_created = event.m_tsc;
+      break;
+    case TraceAllocate:
+      ++ arena.m_numAllocations;
+      arena.m_bytesRequested += event.m_size;
+      arena.m_liveBytes += event.m_size;
+      arena.m_peakLiveBytes = std::max( arena.m_peakLiveBytes, arena.m_liveBytes );
+      arena.m_live[ event.m_address ] = liveAllocation{ event.m_tsc, event.m_size };
+      break;
+    case TraceDeallocate:
+    {
+      ++ arena.m_numDeallocations;
+      std::map< uint64_t, liveAllocation >::iterator live = arena.m_live.find( event.m_address );
+      if( live != arena.m_live.end() )
+      {
+	arena.end( event.m_tsc, live->second.m_tsc, ticksPerNs );
+	arena.m_liveBytes -= live->second.m_size;
+	arena.m_live.erase( live );
+      }
+      break;
+    }
+    case TraceNewBlock:
+      ++ arena.m_numBlocks;
+      arena.m_blockBytes += event.m_size;
+      break;
+    case TraceReset:
+      arena.endAll( event.m_tsc, ticksPerNs );
+      break;
+    case TraceDestroy:
+      arena.endAll( event.m_tsc, ticksPerNs );
+      arena.m_destroyed = event.m_tsc;
+      current.erase( itr );
+      break;
+    default:
+      break;
+    }
+  }
+
+  for( std::size_t i = 0; i < arenas.size(); i++ )
+  {
+    const arenaRecord& arena = arenas[i];
+    std::cout << "\narena 0x" << std::hex << arena.m_address << std::dec;
+    if( arena.m_created )
+      std::cout << " created at " << ( arena.m_created - origin ) / ticksPerNs / 1e6 << " ms";
+    if( arena.m_destroyed )
+      std::cout << " destroyed at " << ( arena.m_destroyed - origin ) / ticksPerNs / 1e6 << " ms";
+    std::cout << "\n  " << arena.m_numAllocations << " allocations of " << arena.m_bytesRequested << " bytes, "
+	      << arena.m_numDeallocations << " deallocations, " << arena.m_numBlocks << " blocks of "
+	      << arena.m_blockBytes << " bytes\n  peak live " << arena.m_peakLiveBytes << " bytes, "
+	      << arena.m_live.size() << " allocations of " << arena.m_liveBytes << " bytes live at the end, "
+	      << arena.m_endedByArena << " ended by reset or destroy\n  lifetimes (ns):";
+
+    for( int bucket = 0; bucket < 64; bucket++ )
+      if( arena.m_lifetimes[ bucket ] )
+	std::cout << " <" << ( 2ULL << bucket ) << ":" << arena.m_lifetimes[ bucket ];
+    std::cout << std::endl;
+  }
+
+  return 0;
+}